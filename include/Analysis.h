@@ -0,0 +1,71 @@
+#ifndef CHIP_8_ANALYSIS_H
+#define CHIP_8_ANALYSIS_H
+#include "Quirks.h"
+
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Chip8;
+
+// What static analysis of a loaded program found reachable from its entry
+// point, following jumps, calls, returns and skips. Bnnn targets depend on
+// a register, so they are only bounded, not followed: code reached through
+// them alone is missing, and is found at run time as usual.
+// Bitmaps span XO-CHIP's 64K; for other machines only the first 4K is used.
+struct Analysis {
+    std::bitset<0x10000> instructions; // Addresses an instruction starts at
+    std::bitset<0x10000> leaders;      // Addresses a basic block starts at
+    std::vector<uint16_t> idle_loops;     // Jumps that close an idle loop
+    std::vector<uint16_t> computed_jumps; // Bnnn, to nnn up to nnn + 0xFF
+
+    // Part of a reachable instruction; everything else is data or unused
+    bool IsCode(const uint16_t address) const {
+        return instructions[address] ||
+               instructions[static_cast<uint16_t>(address - 1)];
+    }
+};
+
+// Analyse `chip`'s program from its pc, decoding under its quirk profile
+Analysis Analyze(const Chip8 &chip);
+
+// Analyses by program content and quirk profile, kept in memory and in one
+// file per program under `directory`, so a program is analysed once however
+// many runs, or processes, load it. Safe to share between threads.
+class AnalysisCache {
+public:
+    explicit AnalysisCache(std::string directory);
+
+    // The analysis of `chip`'s program, freshly loaded: cached, or made now
+    // and stored
+    std::shared_ptr<const Analysis> Get(const Chip8 &chip);
+    // A copy of `chip`, freshly loaded, with its program decoded (and under
+    // the threaded engine translated). Runs Fork it to share that work
+    // instead of redoing it.
+    std::shared_ptr<const Chip8> Prepared(const Chip8 &chip);
+
+    uint64_t hits{};   // Found in memory or on disk
+    uint64_t misses{}; // Analysed
+
+private:
+    std::shared_ptr<const Analysis> Load(const std::string &filename,
+                                         uint64_t hash, Profile profile);
+    void Store(const std::string &filename, uint64_t hash, Profile profile,
+               const Analysis &analysis);
+
+    struct Entry {
+        std::shared_ptr<const Analysis> analysis;
+        std::shared_ptr<const Chip8> prepared[2]; // By engine, on request
+    };
+
+    std::string directory;
+    std::mutex mutex;
+    std::map<std::pair<uint64_t, Profile>, Entry> entries;
+};
+
+#endif // CHIP_8_ANALYSIS_H
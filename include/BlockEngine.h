@@ -0,0 +1,67 @@
+#ifndef CHIP_8_BLOCKENGINE_H
+#define CHIP_8_BLOCKENGINE_H
+#include "Chip8.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Alternative execution core: splits code into basic blocks at jumps, calls,
+// skips, RET and stores, translates each block into threaded code once, and
+// runs a whole block without returning to a dispatcher between opcodes.
+// Common opcode sequences are fused into superinstructions on translation.
+class BlockEngine {
+public:
+    // How many times each superinstruction has run
+    struct Fusions {
+        uint64_t load_runs{};   // 6xkk, 6xkk, ...
+        uint64_t load_draws{};  // Annn, Dxyn
+        uint64_t delay_polls{}; // Fx07, 3xkk, 1nnn
+    };
+
+    // For a machine with `size` bytes of memory
+    explicit BlockEngine(size_t size);
+    // A copy sharing this engine's translations, which are immutable: either
+    // side drops its reference on invalidation and translates its own
+    BlockEngine(const BlockEngine &other) = default;
+
+    // Execute instructions until chip.budget is used up
+    void Run(Chip8 &chip);
+    void Invalidate(uint16_t address, size_t length);
+    // Translate a block at each of `leaders` not yet translated
+    void Prewarm(const Chip8 &chip, const std::bitset<0x10000> &leaders);
+
+    Fusions fusions;
+
+private:
+    struct Op {
+        uint8_t token;           // Index into the handler/label tables
+        uint8_t length;          // Instructions covered by this op
+        Instruction instruction; // Predecoded operands
+    };
+
+    struct Block {
+        uint16_t start;      // Address of the first instruction
+        uint16_t low;        // Lowest address the translation depends on
+        uint32_t end;        // Address after the last instruction
+        uint16_t cycles;     // Instructions in the block (fused or not)
+        std::vector<Op> ops; // Threaded code, terminated by an exit op
+    };
+
+    // Specialized per quirk profile, like the handlers they run
+    template <typename Quirks> void Run(Chip8 &chip);
+    template <typename Quirks>
+    const Block *Translate(const Chip8 &chip, uint16_t start);
+    template <typename Quirks> void Execute(Chip8 &chip, const Block &block);
+
+    uint16_t mask;                     // Memory size - 1
+    std::vector<const Block *> blocks; // Translated blocks by start address
+    std::vector<bool> code;            // Bytes covered by a translation
+    // Blocks in use, and those invalidated mid-block. Forks share them.
+    std::vector<std::shared_ptr<const Block>> translated;
+    std::vector<std::shared_ptr<const Block>> retired;
+};
+
+#endif // CHIP_8_BLOCKENGINE_H
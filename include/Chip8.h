@@ -1,30 +1,139 @@
 #ifndef CHIP_8_CHIP8_H
 #define CHIP_8_CHIP8_H
+#include "CowPages.h"
+#include "Display.h"
+#include "Quirks.h"
+#include "Random.h"
+
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+
+struct Analysis;
+class BlockEngine;
+class Chip8;
+class Debugger;
+class Profiler;
+
+// A predecoded instruction: the opcode's handler plus its operands, extracted
+// once per address and reused every time that address is executed.
+struct Instruction {
+    using Handler = void (*)(Chip8 &, const Instruction &);
+
+    Handler handler{}; // nullptr = not decoded
+    uint16_t opcode{};
+    uint16_t nnn{};
+    uint8_t kk{};
+    uint8_t x{};
+    uint8_t y{};
+    uint8_t n{};
+};
+
+// Execution core used by RunCycles
+enum class Engine {
+    Interpreter, // One predecoded instruction per dispatch
+    Threaded,    // Basic blocks translated to threaded code (BlockEngine)
+};
+
+// Why the last RunCycles call stopped executing before its budget ran out
+enum class Idle {
+    None,  // Every cycle was executed
+    Timer, // Polling the delay timer
+    Key,   // Fx0A waiting for a key press
+    Halt,  // Jumping to itself
+    Break, // Stopped by the debugger
+};
 
 class Chip8 {
 public:
-    Chip8(); // Constructor
+    explicit Chip8(Profile profile = Profile::Modern); // Constructor
+    Chip8(Chip8 &&) noexcept;
+    Chip8 &operator=(Chip8 &&) noexcept;
+    ~Chip8(); // Destructor
+    // A copy of this machine that shares its memory, decoded instructions
+    // and translated blocks until either side writes to them, a page (or
+    // block) at a time
+    Chip8 Fork() const;
+    // ROMs load at 0x200 and may fill memory up to its end
+    static size_t MaxRomSize(const Profile profile) {
+        return MemorySize(profile) - 0x200;
+    }
     bool LoadROM(char const *filename);
+    bool LoadROM(const uint8_t *rom, size_t size);
+    // FNV-1a of memory from 0x200 on, identifying the loaded program
+    uint64_t ProgramHash() const;
+    // Decode, and under the threaded engine translate, what `analysis`
+    // found ahead of running it
+    void Prewarm(const Analysis &analysis);
     void HandleOpcode();
+    // Cycles elapsed: `count`, unless the debugger stopped the machine
+    uint64_t RunCycles(uint64_t count);
+    void InvalidateDecoded(uint16_t address, size_t length);
+    bool SoundEnded();
+
+    // Timers are stored as the tick they expire on and evaluated against
+    // the virtual clock only when read
+    uint8_t DelayTimer() const {
+        return delay_expiry > tick ? delay_expiry - tick : 0;
+    }
+    uint8_t SoundTimer() const {
+        return sound_expiry > tick ? sound_expiry - tick : 0;
+    }
+    void SetDelayTimer(const uint8_t value) { delay_expiry = tick + value; }
+    void SetSoundTimer(const uint8_t value) {
+        sound_expiry = tick + value;
+        sound_playing = value > 0;
+    }
+    bool KeyDown(const uint8_t key) const { return keypad >> (key & 0xF) & 1; }
+    // Press or release `key`. Keys change only between RunCycles calls.
+    void SetKey(const uint8_t key, const bool down) {
+        const uint16_t bit = 1 << (key & 0xF);
+        keypad = down ? keypad | bit : keypad & ~bit;
+    }
+    // Restart Cxkk's random sequence; the same seed replays the same bytes
+    void Seed(const uint64_t seed) { rng = SeedRandom(seed); }
 
     bool draw_flag{};
     bool stop_flag{};
 
-    uint8_t v[16]{};             // V0 - VF
-    uint8_t memory[4096]{};      // 4K Memory
-    uint16_t index{};            // Index Register (I)
-    uint16_t pc{};               // Program Counter
-    uint16_t stack[16]{};        // Stack
-    uint8_t sp{};                // Stack Pointer
-    uint8_t delay_timer{};       // Delay Timer
-    uint8_t sound_timer{};       // Sound Timer
-    uint8_t keypad[16]{};        // Hex Keypad (0x0 - 0xF)
-    uint8_t keypad_timers[16]{}; // Keypad Debounce Timer
-    uint8_t gfx[64][32]{};       // Graphics
-    uint16_t opcode{};           // Current Opcode
-
-    const uint8_t font_set[80] = {
+    uint8_t v[16]{};               // V0 - VF
+    CowPages<uint8_t> memory;      // 4K (XO-CHIP: 64K) Memory, shared
+    uint16_t index{};              // Index Register (I)
+    uint16_t pc{};                 // Program Counter
+    uint16_t stack[16]{};          // Stack
+    uint8_t sp{};                  // Stack Pointer
+    Display gfx;                   // Graphics: packed bitplanes
+    uint8_t plane_mask{1};         // Planes drawn to, bit p = plane p
+    uint16_t opcode{};             // Current Opcode
+    CowPages<Instruction> decoded; // Predecoded Instruction Cache
+
+    // SUPER-CHIP / XO-CHIP state
+    uint8_t flags[16]{};   // Fx75/Fx85 user flags (HP-48 RPL flags)
+    uint8_t pattern[16]{}; // F002 audio pattern; only the timer beeps
+    uint8_t pitch{64};     // Fx3A playback pitch, for the pattern
+
+    uint64_t budget{}; // Cycles left in the current RunCycles call
+    Idle idle{Idle::None};
+
+    // Virtual clock: the 60 Hz timers tick every clock_hz / 60 cycles of
+    // emulated time, independent of how fast the host runs them
+    uint64_t cycles{};            // Cycles emulated so far
+    uint32_t clock_hz{700};       // Cycles per emulated second
+    uint64_t tick{};              // Timer ticks so far (from cycles)
+    uint64_t delay_expiry{};      // Tick the Delay Timer reaches 0
+    uint64_t sound_expiry{};      // Tick the Sound Timer reaches 0
+    bool sound_playing{};         // Sound Timer set, end not yet reported
+    uint16_t keypad{};            // Hex Keypad, a bit per key held down
+
+    uint64_t rng{SeedRandom(0)}; // Cxkk generator state
+
+    Profile profile{Profile::Modern};          // Quirks, fixed at startup
+    Engine engine{Engine::Interpreter};        // Core used by RunCycles
+    std::unique_ptr<BlockEngine> block_engine; // Created on first use
+    Profiler *profiler{}; // Counts executions if set (CHIP8_PROFILE builds)
+    Debugger *debugger{}; // Breakpoints and tracing if set, in any build
+
+    static constexpr uint8_t font_set[80] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
         0x20, 0x60, 0x20, 0x20, 0x70, // 1
         0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
@@ -42,6 +151,28 @@ public:
         0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
+    // SUPER-CHIP's 8x10 digits (XO-CHIP's A-F too), at 0xA0 for Fx30
+    static constexpr uint8_t big_font_set[160] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+
+private:
+    Chip8(const Chip8 &parent); // Fork
 };
 
 #endif // CHIP_8_CHIP8_H
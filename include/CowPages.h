@@ -0,0 +1,103 @@
+#ifndef CHIP_8_COWPAGES_H
+#define CHIP_8_COWPAGES_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// An address space of 4K or 64K entries as pages of 256, shared copy-on-write
+// between forked machines. The page table is shared as well, so copying a
+// CowPages costs a reference count whatever the pages hold; the first write
+// gives the writer its own table, then its own copy of the page. Addresses
+// wrap at the size. Every page starts out as a shared blank one.
+template <typename T> class CowPages {
+public:
+    static constexpr int kPageBits = 8;
+    static constexpr int kPageSize = 1 << kPageBits;
+    static constexpr int kMaxPages = 0x10000 >> kPageBits;
+
+    struct Page {
+        T entries[kPageSize]{};
+    };
+
+    // `size` is 0x1000 or 0x10000 entries
+    explicit CowPages(const size_t size = 0x1000)
+        : table(Blank(size)), mask(static_cast<uint16_t>(size - 1)) {}
+
+    size_t Size() const { return size_t{mask} + 1; }
+    // `address` as it wraps into this space
+    uint16_t Wrap(const uint16_t address) const { return address & mask; }
+
+    const T &operator[](const uint16_t address) const {
+        return table->view[(address & mask) >> kPageBits]
+            ->entries[address & (kPageSize - 1)];
+    }
+    // The entry at `address`, first copying its page if it is shared
+    T &Mutable(const uint16_t address) {
+        return Own((address & mask) >> kPageBits)
+            .entries[address & (kPageSize - 1)];
+    }
+    void Write(const uint16_t address, const T &value) {
+        Mutable(address) = value;
+    }
+
+    // Bulk copies. Writing leaves pages that already hold the same entries
+    // shared, so restoring a mostly unchanged image copies little.
+    void Read(uint16_t address, T *out, size_t length) const {
+        while (length) {
+            const auto offset = address & (kPageSize - 1);
+            const auto run = std::min<size_t>(length, kPageSize - offset);
+            const auto &page = *table->view[(address & mask) >> kPageBits];
+            std::copy_n(page.entries + offset, run, out);
+            address += run, out += run, length -= run;
+        }
+    }
+    void Write(uint16_t address, const T *in, size_t length) {
+        while (length) {
+            const auto offset = address & (kPageSize - 1);
+            const auto run = std::min<size_t>(length, kPageSize - offset);
+            const auto number = (address & mask) >> kPageBits;
+            if (!std::equal(in, in + run,
+                            table->view[number]->entries + offset)) {
+                std::copy_n(in, run, Own(number).entries + offset);
+            }
+            address += run, in += run, length -= run;
+        }
+    }
+
+private:
+    struct Table {
+        std::shared_ptr<Page> pages[kMaxPages]; // Past Size(): null
+        Page *view[kMaxPages]{}; // pages, one load away for reads
+    };
+
+    static const std::shared_ptr<Table> &Blank(const size_t size) {
+        static const auto page = std::make_shared<Page>();
+        const auto blank = [](const size_t pages) {
+            auto table = std::make_shared<Table>();
+            std::fill_n(table->pages, pages, page);
+            std::fill_n(table->view, pages, page.get());
+            return table;
+        };
+        static const auto small = blank(0x1000 >> kPageBits);
+        static const auto large = blank(kMaxPages);
+        return size > 0x1000 ? large : small;
+    }
+
+    Page &Own(const int number) {
+        if (table.use_count() != 1) {
+            table = std::make_shared<Table>(*table);
+        }
+        auto &page = table->pages[number];
+        if (page.use_count() != 1) {
+            page = std::make_shared<Page>(*page);
+            table->view[number] = page.get();
+        }
+        return *page;
+    }
+
+    std::shared_ptr<Table> table;
+    uint16_t mask; // Size() - 1
+};
+
+#endif // CHIP_8_COWPAGES_H
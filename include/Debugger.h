@@ -0,0 +1,97 @@
+#ifndef CHIP_8_DEBUGGER_H
+#define CHIP_8_DEBUGGER_H
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Chip8;
+
+// Stop before the instruction at `address` runs, if the condition holds
+struct Breakpoint {
+    enum class Compare : uint8_t { Always, Equal, NotEqual, Less, Greater };
+
+    uint16_t address{};
+    Compare compare{Compare::Always};
+    uint8_t reg{}; // 0-15: Vx, 16: I
+    uint16_t value{};
+
+    bool Holds(const Chip8 &chip) const;
+};
+
+// Stop after an instruction writes any byte from `first` to `last`
+struct Watchpoint {
+    uint16_t first{};
+    uint16_t last{};
+};
+
+// "ADDR", or "ADDR:REG OP VALUE" with REG v0-vf or i and OP one of == != <
+// >, everything in hex: "2a4", "2a4:v3==1f", "2a4:i>eff"
+bool ParseBreakpoint(const std::string &text, Breakpoint &breakpoint);
+// "ADDR" or "FIRST-LAST", in hex
+bool ParseWatchpoint(const std::string &text, Watchpoint &watchpoint);
+
+// Breakpoints, watchpoints, single-stepping and a trace of the last
+// instructions run. A machine with a debugger attached runs this one
+// instruction at a time, but only while there is anything to do: with
+// nothing set, RunCycles keeps its engines, checking once per timer tick
+// rather than once per instruction. Memory writes are seen where Fx33, Fx55
+// and 5xy2 invalidate what they overwrote.
+class Debugger {
+public:
+    enum class Stop { None, Breakpoint, Watchpoint, Step };
+
+    // Keep the last `trace_size` instructions run
+    explicit Debugger(size_t trace_size = 0);
+
+    void Add(const Breakpoint &breakpoint);
+    void Add(const Watchpoint &watchpoint);
+    void Clear();
+
+    // Whether RunCycles has to run the debug loop
+    bool Active() const {
+        return !breakpoints.empty() || !watchpoints.empty() ||
+               !trace.empty() || stopped || steps;
+    }
+    bool Stopped() const { return stopped; }
+    // Carry on after a stop, over any breakpoint where it stopped
+    void Continue();
+    // Run `count` instructions, then stop again
+    void Step(uint64_t count = 1);
+
+    // In place of an engine, from RunCycles: run `chip` up to its budget,
+    // leaving it with Idle::Break if stopped
+    void Run(Chip8 &chip);
+    // From Chip8::InvalidateDecoded: `length` bytes from `address` written
+    void Written(const Chip8 &chip, uint16_t address, size_t length);
+
+    // One line on why it stopped and the registers, for a status bar
+    std::string Status(const Chip8 &chip) const;
+    // The stop, the registers and the trace, oldest instruction first
+    std::string Report(const Chip8 &chip) const;
+
+    Stop stop{Stop::None}; // Why it last stopped
+    uint16_t stop_pc{};    // Where
+    uint16_t written{};    // First watched byte written, for Watchpoint
+
+private:
+    struct Executed {
+        uint64_t cycle;
+        uint16_t pc;
+        uint16_t opcode;
+    };
+
+    std::vector<Breakpoint> breakpoints;
+    std::vector<Watchpoint> watchpoints;
+    std::bitset<0x10000> armed; // Addresses with a breakpoint
+    std::vector<Executed> trace; // Ring buffer
+    size_t traced{};             // Instructions recorded, ever
+    uint64_t steps{};            // Left before stopping, 0 = not stepping
+    bool stopped{};
+    bool resuming{}; // Skip the breakpoint at pc once
+    bool running{};  // Inside Run, where writes are checked
+    bool hit{};      // A watched byte was written by this instruction
+};
+
+#endif // CHIP_8_DEBUGGER_H
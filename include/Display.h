@@ -0,0 +1,93 @@
+#ifndef CHIP_8_DISPLAY_H
+#define CHIP_8_DISPLAY_H
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+// The screen as packed bitplanes. A row of pixels is one 64-bit word in low
+// resolution (64x32) and two in high resolution (128x64, SUPER-CHIP), most
+// significant bit leftmost, so a sprite row costs one or two word XORs and a
+// scroll is a word move or shift at either resolution. XO-CHIP draws to two
+// planes; everything else to plane 0 only.
+//
+// A plain CHIP-8 display is plane 0 at 64x32, held inline. An extended one
+// (SUPER-CHIP, XO-CHIP) keeps both planes at either resolution out of line,
+// so machines that never leave 64x32 don't carry them.
+struct Display {
+    static constexpr int kPlanes = 2;      // At most
+    static constexpr int kWords = 2 * 64;  // Per plane, enough for 128x64
+    static constexpr int kLowresWords = 32;
+
+    Display() = default;
+    explicit Display(const bool extended) {
+        if (extended) {
+            words = std::make_unique<uint64_t[]>(kPlanes * kWords);
+        }
+    }
+    Display(const Display &other) { *this = other; }
+    Display &operator=(const Display &other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (!other.words) {
+            words.reset();
+            std::copy_n(other.lores, kLowresWords, lores);
+        } else {
+            if (!words) {
+                words = std::make_unique<uint64_t[]>(kPlanes * kWords);
+            }
+            std::copy_n(other.words.get(), kPlanes * kWords, words.get());
+        }
+        hires = other.hires;
+        return *this;
+    }
+    Display(Display &&) noexcept = default;
+    Display &operator=(Display &&) noexcept = default;
+
+    int Width() const { return hires ? 128 : 64; }
+    int Height() const { return hires ? 64 : 32; }
+    int Stride() const { return hires ? 2 : 1; }      // Words per row
+    int Words() const { return Height() * Stride(); } // Words per plane
+
+    bool Extended() const { return words != nullptr; }
+    int Planes() const { return words ? kPlanes : 1; }
+    // Plane `p`, below Planes()
+    uint64_t *Plane(const int p) {
+        return words ? words.get() + p * kWords : lores;
+    }
+    const uint64_t *Plane(const int p) const {
+        return words ? words.get() + p * kWords : lores;
+    }
+    // Word `word` (below Words()) of plane `p`, zero for a plane this
+    // display doesn't have
+    uint64_t Word(const int p, const int word) const {
+        return p < Planes() ? Plane(p)[word] : 0;
+    }
+
+    // The planes lit at (x, y), bit p for plane p
+    int Pixel(const int x, const int y) const {
+        const int word = y * Stride() + x / 64;
+        const uint64_t bit = 1ULL << 63 >> x % 64;
+        return (Word(0, word) & bit ? 1 : 0) | (Word(1, word) & bit ? 2 : 0);
+    }
+
+    // Blank both planes and return to 64x32
+    void Clear() {
+        if (words) {
+            std::fill_n(words.get(), kPlanes * kWords, 0);
+        } else {
+            std::fill_n(lores, kLowresWords, 0);
+        }
+        hires = false;
+    }
+
+    // Words past Words() are always zero: changing resolution clears both
+    // planes
+    bool hires{};
+
+private:
+    uint64_t lores[kLowresWords]{};   // Plane 0 unless extended
+    std::unique_ptr<uint64_t[]> words; // Extended: kPlanes planes of kWords
+};
+
+#endif // CHIP_8_DISPLAY_H
@@ -0,0 +1,35 @@
+#ifndef CHIP_8_FRAMESCHEDULER_H
+#define CHIP_8_FRAMESCHEDULER_H
+#include <chrono>
+#include <cstdint>
+
+// Paces emulation in 60 Hz frames: each frame runs a batch of cycles, then
+// the host ticks timers, presents, and sleeps until the next frame's
+// deadline. Turbo mode never sleeps and only presents every
+// (frame_skip + 1)th frame.
+class FrameScheduler {
+public:
+    static constexpr int kFrameRate = 60;
+
+    FrameScheduler(double cycles_per_second, bool turbo, int frame_skip);
+
+    // Cycles to run this frame; fractional rates are carried between frames
+    uint64_t NextBatch();
+    // Whether this frame should be rendered
+    bool ShouldPresent() const;
+    // Finish the frame, sleeping until the next deadline unless in turbo.
+    // An idle machine (only input can wake it) is paced even in turbo.
+    void EndFrame(bool idle = false);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double cycles_per_second;
+    double carry{}; // 60ths of a cycle owed to the next frame
+    bool turbo;
+    int frame_skip;
+    uint64_t frame{};
+    Clock::time_point deadline;
+};
+
+#endif // CHIP_8_FRAMESCHEDULER_H
@@ -0,0 +1,119 @@
+#ifndef CHIP_8_FRAMESINK_H
+#define CHIP_8_FRAMESINK_H
+#include "Display.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where presented frames go: the terminal, or for headless runs one of the
+// writers below
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    virtual void Present(const Display &gfx) = 0;
+};
+
+// FNV-1a of a frame: plane 0 at the current resolution, then plane 1 only if
+// anything is lit in it, so CHIP-8 frames hash the same under every profile
+uint64_t HashFrame(const Display &gfx);
+
+// Appends to a file from a background thread. Writes fill one buffer while
+// the other goes to disk, so the writing thread only waits if it outruns
+// the disk by a whole buffer.
+class BackgroundWriter {
+public:
+    BackgroundWriter() = default;
+    BackgroundWriter(const BackgroundWriter &) = delete;
+    BackgroundWriter &operator=(const BackgroundWriter &) = delete;
+    ~BackgroundWriter();
+
+    bool Open(const char *filename);
+    void Write(const void *data, size_t size);
+    // Write out what is buffered and close, false if any write failed
+    bool Close();
+
+private:
+    static constexpr size_t kBufferSize = 64 << 10;
+
+    void Hand(); // The filled buffer to the thread
+    void Run();
+
+    std::ofstream file;
+    std::string filename;
+    std::string filling; // Writer's
+    std::string writing; // Thread's while `pending`
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool pending{}; // `writing` holds data for the thread
+    bool closing{};
+    bool failed{};
+    std::thread thread;
+};
+
+// Every frame, compressed. Each record is a tag byte (bit 0: keyframe, bit
+// 1: high resolution) and the frame XORed with the one before it, or with a
+// blank display for a keyframe: both planes' words as runs of a count of
+// unchanged words and a count of changed ones (LEB128 varints) followed by
+// those words (8 bytes each, little-endian), up to the end of the frame.
+// An unchanged frame takes a few bytes. Keyframes come every
+// `keyframe_interval` frames and on every change of resolution, so no frame
+// depends on more than that many before it.
+//   File layout: "C8FS", version (1 byte), 3 reserved, then the records.
+class FrameStreamWriter : public FrameSink {
+public:
+    explicit FrameStreamWriter(int keyframe_interval = 600);
+
+    bool Open(const char *filename);
+    void Present(const Display &gfx) override;
+    bool Close();
+
+    uint64_t frames{};
+
+private:
+    int keyframe_interval;
+    Display last;
+    std::string record; // Reused between frames
+    BackgroundWriter out;
+};
+
+// Reads the frames of a FrameStreamWriter file back in order
+class FrameStreamReader {
+public:
+    bool Open(const char *filename);
+    // The next frame into `gfx`, false at the end. Throws if the file is
+    // corrupt.
+    bool Next(Display &gfx);
+
+private:
+    uint8_t Byte();
+    uint64_t Varint();
+
+    std::string data;
+    size_t at{};
+    Display last;
+};
+
+// One hash per frame, one frame per line as 16 hex digits, to compare runs
+// by: the first line two traces differ on is the first frame that did
+class FrameHashWriter : public FrameSink {
+public:
+    bool Open(const char *filename);
+    void Present(const Display &gfx) override;
+    bool Close();
+
+private:
+    BackgroundWriter out;
+};
+
+// The frame hashes of a trace: a FrameHashWriter file, or a frame stream,
+// whose frames are hashed. False if it can't be read.
+bool LoadFrameHashes(const char *filename, std::vector<uint64_t> &hashes);
+
+#endif // CHIP_8_FRAMESINK_H
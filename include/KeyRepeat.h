@@ -0,0 +1,29 @@
+#ifndef CHIP_8_KEYREPEAT_H
+#define CHIP_8_KEYREPEAT_H
+#include <chrono>
+#include <cstdint>
+
+// Terminals report key presses but not releases: a held key is pressed
+// again at the repeat rate once the repeat delay has passed. A key counts as
+// held from its first press until no repeat arrives in time, allowing the
+// delay after the first press and the interval after later ones.
+class KeyRepeat {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    KeyRepeat(Clock::duration delay, Clock::duration interval);
+
+    // A press of `key` arrived; true if it wasn't already held
+    bool Press(uint8_t key, Clock::time_point now);
+    // Keys no longer held at `now`, a bit per key
+    uint16_t Release(Clock::time_point now);
+
+private:
+    Clock::duration delay;
+    Clock::duration interval;
+    uint16_t held{};
+    uint16_t repeating{};       // Pressed again since first held
+    Clock::time_point last[16]; // Latest press of each key
+};
+
+#endif // CHIP_8_KEYREPEAT_H
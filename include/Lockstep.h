@@ -0,0 +1,97 @@
+#ifndef CHIP_8_LOCKSTEP_H
+#define CHIP_8_LOCKSTEP_H
+#include "Quirks.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Chip8;
+
+// Steps many machines ("lanes") in lockstep for search and fuzzing. Registers,
+// PCs, timers and keys are kept in structure-of-arrays form, one array per
+// register holding every lane, so an instruction shared by a group of lanes
+// runs as one masked loop the compiler vectorizes.
+//
+// Each step runs the group of lanes at the lowest PC that fetch the same
+// opcode. Lanes that branch differently fall into separate groups and merge
+// again when their paths rejoin. Memory and the display stay per lane.
+//
+// Lanes are 64x32 CHIP-8 machines with 4K of memory. Under the SUPER-CHIP
+// and XO-CHIP profiles their extra instructions fault a lane, as does
+// loading a machine in 128x64 mode or with 64K of memory.
+class LockstepEngine {
+public:
+    explicit LockstepEngine(size_t lanes, Profile profile = Profile::Modern);
+
+    size_t Lanes() const { return lanes; }
+
+    // Copy a machine's state into / out of a lane
+    void Load(size_t lane, const Chip8 &chip);
+    void Store(size_t lane, Chip8 &chip) const;
+
+    // Keys held down in a lane, bit n = key n
+    void SetKeys(size_t lane, uint16_t keys) { keypad[lane] = keys; }
+    // Seed a lane's Cxkk random number generator
+    void Seed(size_t lane, uint64_t seed);
+
+    // Run every lane for `cycles` cycles. A lane that jumps to itself or
+    // waits for a key that is not held skips to the end, like RunCycles; one
+    // that hits an unknown opcode stops and is marked faulted.
+    void Run(uint64_t cycles);
+
+    bool Faulted(size_t lane) const { return faulted[lane]; }
+    uint64_t Cycles(size_t lane) const { return cycles[lane]; }
+    const uint64_t *Display(size_t lane) const { return &gfx[lane * 32]; }
+
+    uint32_t clock_hz{700}; // Cycles per emulated second, for the timers
+
+    // Group steps run, and lanes stepped by them: their ratio is the
+    // average number of lanes sharing each step
+    uint64_t steps{};
+    uint64_t lane_steps{};
+
+private:
+    template <typename Quirks> void Run(uint64_t cycles);
+    template <typename Quirks> void Execute(uint16_t opcode, uint16_t pc);
+    void Fault(size_t lane);
+
+    uint8_t *V(const int x) { return &v[x * lanes]; }
+    uint8_t *Memory(const size_t lane) { return &memory[lane * 4096]; }
+    uint64_t Tick(const size_t lane) const {
+        return (cycles[lane] - remaining[lane]) * 60 / clock_hz;
+    }
+    // Record a store so code there is fetched per lane from now on
+    void Written(uint16_t address, int length);
+
+    size_t lanes;
+    Profile profile;
+
+    // One entry per lane, registers and the stack one array per slot
+    std::vector<uint8_t> v;       // V0-VF
+    std::vector<uint16_t> index;  // I
+    std::vector<uint16_t> pc;     // Program Counter
+    std::vector<uint16_t> stack;  // Stack
+    std::vector<uint8_t> sp;      // Stack Pointer
+    std::vector<uint16_t> keypad; // Hex Keypad, bit per key
+    std::vector<uint64_t> cycles; // Virtual clock, at the end of the Run
+    std::vector<uint64_t> delay_expiry;
+    std::vector<uint64_t> sound_expiry;
+    std::vector<uint64_t> rng;       // Cxkk generator state
+    std::vector<uint64_t> remaining; // Cycles left in the Run
+    std::vector<uint8_t> faulted;
+    std::vector<uint8_t> active; // Cycles left, 0 or 1
+    std::vector<uint8_t> mask;   // Lanes in the current step, 0 or 1
+
+    std::vector<uint8_t> memory; // 4096 bytes per lane
+    std::vector<uint64_t> gfx;   // 32 rows per lane
+
+    // While every lane holds the same memory, an opcode is fetched once per
+    // step instead of once per lane, except where a lane has stored since
+    bool uniform{true};
+    bool recheck{};            // A Load may have changed `uniform`
+    std::bitset<4096> written; // Stored to since memory was last uniform
+};
+
+#endif // CHIP_8_LOCKSTEP_H
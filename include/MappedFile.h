@@ -0,0 +1,31 @@
+#ifndef CHIP_8_MAPPEDFILE_H
+#define CHIP_8_MAPPEDFILE_H
+#include <cstddef>
+#include <cstdint>
+
+// A whole file mapped read-only into memory. Pages are read in by the OS on
+// first touch and shared between every thread (and process) mapping it.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    // Map `filename`, replacing any previous mapping. False if it can't be
+    // opened or isn't a regular file.
+    bool Open(const char *filename);
+
+    const uint8_t *Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    void Close();
+
+    const uint8_t *data{}; // nullptr for an empty file
+    size_t size{};
+};
+
+#endif // CHIP_8_MAPPEDFILE_H
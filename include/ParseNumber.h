@@ -0,0 +1,22 @@
+#ifndef CHIP_8_PARSENUMBER_H
+#define CHIP_8_PARSENUMBER_H
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+// All of `text` as a number of at least `min`. Signs on unsigned types,
+// trailing characters and out-of-range values are all rejected.
+template <typename T>
+bool ParseNumber(const std::string_view text, T &value, const T min) {
+    T parsed;
+    const auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (text.empty() || error != std::errc{} ||
+        end != text.data() + text.size() || parsed < min) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+#endif // CHIP_8_PARSENUMBER_H
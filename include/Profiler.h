@@ -0,0 +1,160 @@
+#ifndef CHIP_8_PROFILER_H
+#define CHIP_8_PROFILER_H
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Execution profiling is compiled in with -DCHIP8_PROFILE=ON. Without it
+// every hook below is discarded at compile time.
+#ifdef CHIP8_PROFILE
+constexpr bool kProfiling = true;
+#else
+constexpr bool kProfiling = false;
+#endif
+
+// Where the host's time goes, per frame of the frontend loop
+enum class Section {
+    Emulate, // RunCycles
+    Render,
+    Input,
+    Sleep, // Waiting for the next frame's deadline
+    Count,
+};
+
+// Counts executed instructions by opcode family and by address, and times
+// the frontend's frames. Idle loops that are fast-forwarded only count the
+// instructions that actually ran.
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int kFamilies = 52; // The last is unknown opcodes
+
+    // Times the enclosing scope into `section`
+    class Scope {
+    public:
+        Scope(Profiler *profiler, const Section section)
+            : profiler(profiler), section(section) {
+            if constexpr (kProfiling) {
+                if (profiler) {
+                    start = Clock::now();
+                }
+            }
+        }
+        ~Scope() {
+            if constexpr (kProfiling) {
+                if (profiler) {
+                    profiler->seconds[static_cast<int>(section)] +=
+                        std::chrono::duration<double>(Clock::now() - start)
+                            .count();
+                }
+            }
+        }
+
+    private:
+        Profiler *profiler;
+        Section section;
+        std::chrono::steady_clock::time_point start{};
+    };
+
+    Profiler();
+
+    void Count(const uint16_t address, const uint16_t opcode) {
+        families[Family(opcode)]++;
+        addresses[address]++;
+    }
+    // Close a frontend frame after `cycles` more emulated cycles
+    void EndFrame(uint64_t cycles);
+    size_t Frames() const { return frame_ms.size(); }
+    // A key press reached the frontend `latency` before the first frame
+    // emulated with it was handed to the renderer
+    void InputLatency(const Clock::duration latency) {
+        latency_ms.push_back(
+            std::chrono::duration<float, std::milli>(latency).count());
+    }
+
+    // Opcode families in handler order: 00E0, 00EE, 0nnn, 1nnn, ..., Fx65,
+    // then the SUPER-CHIP and XO-CHIP ones, 00Cn to Fx85, whatever the
+    // profile
+    static int Family(const uint16_t opcode) {
+        constexpr int kUnknown = kFamilies - 1;
+        constexpr int kExtensions = 35;
+        const uint8_t kk = opcode & 0xFF;
+        switch (opcode >> 12) {
+            case 0x0:
+                if ((opcode & 0xFFF0) == 0x00C0) {
+                    return kExtensions;
+                } else if ((opcode & 0xFFF0) == 0x00D0) {
+                    return kExtensions + 1;
+                } else if (opcode >= 0x00FB && opcode <= 0x00FF) {
+                    return kExtensions + 2 + (opcode - 0x00FB);
+                }
+                return opcode == 0x00E0 ? 0 : opcode == 0x00EE ? 1 : 2;
+            case 0x5: {
+                const int n = opcode & 0xF;
+                if (n == 2 || n == 3) {
+                    return kExtensions + 5 + n; // 5xy2, 5xy3
+                }
+                return n ? kUnknown : 7;
+            }
+            case 0x8: {
+                constexpr int8_t kAlu[16] = {10, 11, 12, 13, 14, 15, 16, 17,
+                                             -1, -1, -1, -1, -1, -1, 18, -1};
+                const auto family = kAlu[opcode & 0xF];
+                return family < 0 ? kUnknown : family;
+            }
+            case 0x9:
+                return opcode & 0xF ? kUnknown : 19;
+            case 0xE:
+                return kk == 0x9E ? 24 : kk == 0xA1 ? 25 : kUnknown;
+            case 0xF: {
+                constexpr uint8_t kMisc[9] = {0x07, 0x0A, 0x15, 0x18, 0x1E,
+                                              0x29, 0x33, 0x55, 0x65};
+                for (auto i = 0; i < 9; i++) {
+                    if (kk == kMisc[i]) {
+                        return 26 + i;
+                    }
+                }
+                constexpr uint8_t kExtended[7] = {0x00, 0x01, 0x02, 0x30,
+                                                  0x3A, 0x75, 0x85};
+                for (auto i = 0; i < 7; i++) {
+                    if (kk == kExtended[i]) {
+                        return kExtensions + 9 + i;
+                    }
+                }
+                return kUnknown;
+            }
+            default: {
+                // 1nnn - 4xkk, 6xkk, 7xkk, Annn - Dxyn
+                constexpr int8_t kSimple[16] = {0, 3, 4,  5,  6,  0,  8, 9,
+                                                0, 0, 20, 21, 22, 23, 0, 0};
+                return kSimple[opcode >> 12];
+            }
+        }
+    }
+    static const char *FamilyName(int family);
+
+    // Emulated cycles per second of host time since the profiler started
+    double AchievedHz() const;
+    // One line for the frontend: speed against `target_hz`, frame times
+    std::string Status(double target_hz) const;
+    // The full report: hot opcodes and addresses, sections, frame times
+    bool Write(const char *filename, double target_hz) const;
+
+private:
+    static double Percentile(const std::vector<float> &values,
+                             double fraction);
+
+    uint64_t families[kFamilies]{};
+    uint64_t addresses[0x10000]{};
+    double seconds[static_cast<int>(Section::Count)]{};
+    Clock::time_point started;
+    Clock::time_point frame_start;
+    uint64_t cycles{};
+    std::vector<float> frame_ms;   // Host time of each frame, sleep included
+    std::vector<float> latency_ms; // Of each key press, see InputLatency
+};
+
+#endif // CHIP_8_PROFILER_H
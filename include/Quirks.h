@@ -0,0 +1,139 @@
+#ifndef CHIP_8_QUIRKS_H
+#define CHIP_8_QUIRKS_H
+#include <cstddef>
+#include <string_view>
+
+// Instruction sets beyond CHIP-8's a profile decodes, each including the last
+enum class Extensions {
+    None,
+    SuperChip, // 128x64 mode, scrolling, 16x16 sprites, big font, flags
+    XoChip,    // Two bitplanes, 64K memory, F000 nnnn, register ranges
+};
+
+// How Fx55/Fx65 leave I after the transfer
+enum class IndexIncrement {
+    None,     // I is unchanged
+    X,        // I += x
+    XPlusOne, // I += x + 1
+};
+
+// Compile-time quirk profiles. The opcode handlers take one as a template
+// argument, so each profile compiles into its own branch-free specialization.
+struct CosmacVip {
+    static constexpr bool shift_uses_vy = true;   // 8xy6/8xyE shift Vy
+    static constexpr bool logic_resets_vf = true; // 8xy1/8xy2/8xy3 clear VF
+    static constexpr IndexIncrement load_store = IndexIncrement::XPlusOne;
+    static constexpr bool jump_uses_vx = false; // Bxnn jumps to xnn + Vx
+    static constexpr bool clip_sprites = true;  // Dxyn clips at the edges
+    static constexpr Extensions extensions = Extensions::None;
+};
+
+struct Chip48 {
+    static constexpr bool shift_uses_vy = false;
+    static constexpr bool logic_resets_vf = false;
+    static constexpr IndexIncrement load_store = IndexIncrement::X;
+    static constexpr bool jump_uses_vx = true;
+    static constexpr bool clip_sprites = true;
+    static constexpr Extensions extensions = Extensions::None;
+};
+
+struct SuperChip {
+    static constexpr bool shift_uses_vy = false;
+    static constexpr bool logic_resets_vf = false;
+    static constexpr IndexIncrement load_store = IndexIncrement::None;
+    static constexpr bool jump_uses_vx = true;
+    static constexpr bool clip_sprites = true;
+    static constexpr Extensions extensions = Extensions::SuperChip;
+};
+
+struct Modern {
+    static constexpr bool shift_uses_vy = true;
+    static constexpr bool logic_resets_vf = false;
+    static constexpr IndexIncrement load_store = IndexIncrement::None;
+    static constexpr bool jump_uses_vx = false;
+    static constexpr bool clip_sprites = false;
+    static constexpr Extensions extensions = Extensions::None;
+};
+
+// As Octo runs it
+struct XoChip {
+    static constexpr bool shift_uses_vy = true;
+    static constexpr bool logic_resets_vf = false;
+    static constexpr IndexIncrement load_store = IndexIncrement::XPlusOne;
+    static constexpr bool jump_uses_vx = false;
+    static constexpr bool clip_sprites = false;
+    static constexpr Extensions extensions = Extensions::XoChip;
+};
+
+// Runtime name of a profile, chosen once at startup
+enum class Profile {
+    CosmacVip,
+    Chip48,
+    SuperChip,
+    Modern,
+    XoChip,
+};
+
+// Call `f` with a value of the profile type selected by `profile`
+template <typename F> decltype(auto) WithQuirks(const Profile profile, F &&f) {
+    switch (profile) {
+        case Profile::CosmacVip:
+            return f(CosmacVip{});
+        case Profile::Chip48:
+            return f(Chip48{});
+        case Profile::SuperChip:
+            return f(SuperChip{});
+        case Profile::XoChip:
+            return f(XoChip{});
+        default:
+            return f(Modern{});
+    }
+}
+
+inline bool ParseProfile(const std::string_view name, Profile &profile) {
+    if (name == "vip") {
+        profile = Profile::CosmacVip;
+    } else if (name == "chip48") {
+        profile = Profile::Chip48;
+    } else if (name == "schip") {
+        profile = Profile::SuperChip;
+    } else if (name == "modern") {
+        profile = Profile::Modern;
+    } else if (name == "xochip") {
+        profile = Profile::XoChip;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline const char *ProfileName(const Profile profile) {
+    switch (profile) {
+        case Profile::CosmacVip:
+            return "vip";
+        case Profile::Chip48:
+            return "chip48";
+        case Profile::SuperChip:
+            return "schip";
+        case Profile::XoChip:
+            return "xochip";
+        default:
+            return "modern";
+    }
+}
+
+// Addressable memory: 4K, or 64K under XO-CHIP
+inline size_t MemorySize(const Profile profile) {
+    return WithQuirks(profile, []<typename Quirks>(Quirks) -> size_t {
+        return Quirks::extensions == Extensions::XoChip ? 0x10000 : 0x1000;
+    });
+}
+
+// Whether the display needs 128x64 (SUPER-CHIP) or a second plane (XO-CHIP)
+inline bool ExtendedDisplay(const Profile profile) {
+    return WithQuirks(profile, []<typename Quirks>(Quirks) {
+        return Quirks::extensions != Extensions::None;
+    });
+}
+
+#endif // CHIP_8_QUIRKS_H
@@ -0,0 +1,25 @@
+#ifndef CHIP_8_RANDOM_H
+#define CHIP_8_RANDOM_H
+#include <cstdint>
+
+// Cxkk's random number generator: xorshift64*, a few instructions per byte
+// and 8 bytes of state, so every instance can own one and reproduce its
+// sequence from a seed.
+
+// Generator state for `seed`. SplitMix64 spreads nearby seeds apart and
+// never leaves the state 0, which xorshift cannot leave.
+inline uint64_t SeedRandom(const uint64_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15;
+    z = (z ^ z >> 30) * 0xBF58476D1CE4E5B9;
+    z = (z ^ z >> 27) * 0x94D049BB133111EB;
+    return (z ^ z >> 31) | 1;
+}
+
+inline uint8_t NextRandom(uint64_t &state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (state * 0x2545F4914F6CDD1D) >> 56;
+}
+
+#endif // CHIP_8_RANDOM_H
@@ -0,0 +1,49 @@
+#ifndef CHIP_8_RECORDING_H
+#define CHIP_8_RECORDING_H
+#include "Quirks.h"
+
+#include <cstdint>
+#include <vector>
+
+class Chip8;
+
+// A key press or release at an emulated cycle
+struct KeyEvent {
+    uint64_t cycle;
+    uint8_t key;
+    bool down;
+};
+
+// Everything needed to rerun a session bit-exactly: the configuration, the
+// Cxkk seed and the key presses and releases, timed in emulated cycles. Host
+// timing never enters the emulation, so a replay can run at any speed.
+class Recording {
+public:
+    Recording() = default;
+    // Start recording `chip`, freshly loaded and seeded with `seed`
+    Recording(const Chip8 &chip, uint64_t seed);
+
+    // Press or release a key on `chip` and record it
+    void SetKey(Chip8 &chip, uint8_t key, bool down);
+    // Mark the end of the session
+    void Finish(const Chip8 &chip);
+
+    bool Save(const char *filename) const;
+    bool Load(const char *filename);
+
+    // Rerun the session on `chip`, freshly loaded with the same ROM and
+    // quirks, up to cycle `until` (the end by default). Called again with a
+    // later cycle it carries on from there, key events on `until` itself
+    // being left to that call. Throws if the ROM or quirks don't match, or
+    // whatever the ROM throws.
+    void Replay(Chip8 &chip, uint64_t until = UINT64_MAX) const;
+
+    Profile profile{Profile::Modern};
+    uint32_t clock_hz{};
+    uint64_t seed{};
+    uint64_t rom_hash{}; // Of memory 0x200 onwards when recording started
+    uint64_t end{};      // Cycle the session ended on
+    std::vector<KeyEvent> events;
+};
+
+#endif // CHIP_8_RECORDING_H
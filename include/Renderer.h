@@ -0,0 +1,32 @@
+#ifndef CHIP_8_RENDERER_H
+#define CHIP_8_RENDERER_H
+#include "Display.h"
+#include "FrameSink.h"
+
+#include <cstdint>
+
+// ncurses renderer that remembers the last presented frame and only sends the
+// cells that changed. Half-block mode packs two display rows into one
+// terminal cell with Unicode block characters, halving the output. Pixels lit
+// in XO-CHIP's second plane are coloured where the terminal has colours.
+class TerminalRenderer : public FrameSink {
+public:
+    explicit TerminalRenderer(bool half_blocks = false);
+
+    // Draw the cells of `gfx` that differ from the last presented frame
+    void Present(const Display &gfx) override;
+    // Repaint everything on the next Present (e.g. after a resize)
+    void Invalidate();
+
+private:
+    void DrawCell(int x, int row, const Display &gfx) const;
+
+    bool half_blocks;
+    bool colors{};          // Colour pairs are set up
+    bool valid{};           // `shown` matches the terminal
+    Display shown;          // Last presented frame
+    int term_y{}, term_x{}; // Terminal size `shown` was drawn for
+    int start_y{}, start_x{};
+};
+
+#endif // CHIP_8_RENDERER_H
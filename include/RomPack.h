@@ -0,0 +1,42 @@
+#ifndef CHIP_8_ROMPACK_H
+#define CHIP_8_ROMPACK_H
+#include "MappedFile.h"
+#include "Quirks.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// A ROM in a pack, with the configuration it is meant to run under. Name and
+// data point into the pack's mapping, or the caller's buffers when writing.
+struct PackedRom {
+    std::string_view name;
+    Profile profile{Profile::Modern};
+    uint32_t clock_hz{}; // 0 = unspecified
+    const uint8_t *data{};
+    size_t size{};
+    uint64_t hash{}; // FNV-1a of the data, see RomPack::Hash
+};
+
+// Many ROMs in one file, behind an index sorted by hash. The file is mapped
+// once and the index read on Open; after that any number of threads can
+// load its ROMs without a system call each.
+class RomPack {
+public:
+    bool Open(const char *filename);
+    // Write `roms` as a pack, hashing each; they needn't be sorted
+    static bool Write(const char *filename, std::vector<PackedRom> roms);
+
+    const std::vector<PackedRom> &Roms() const { return roms; }
+    // The first ROM with `hash`, or nullptr
+    const PackedRom *Find(uint64_t hash) const;
+
+    static uint64_t Hash(const uint8_t *data, size_t size);
+
+private:
+    MappedFile file;
+    std::vector<PackedRom> roms; // In index order, by hash
+};
+
+#endif // CHIP_8_ROMPACK_H
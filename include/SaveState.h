@@ -0,0 +1,54 @@
+#ifndef CHIP_8_SAVESTATE_H
+#define CHIP_8_SAVESTATE_H
+#include "Quirks.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class Chip8;
+
+// A machine's state as a little-endian image of whole words: memory, display,
+// registers, stack, the virtual clock with its timers and keys, the Cxkk
+// generator and the SUPER-CHIP / XO-CHIP extras. Its size depends only on
+// the quirk profile (XO-CHIP has 64K of memory). Caches (decoded
+// instructions, translated blocks) are rebuilt.
+using StateImage = std::vector<uint64_t>;
+size_t StateWords(Profile profile);
+
+// Capturing sizes `image` to the machine; restoring needs it that size
+void CaptureState(const Chip8 &chip, StateImage &image);
+void RestoreState(Chip8 &chip, const StateImage &image);
+
+// A save file is a versioned header followed by the image. Loading fails on
+// a different version or quirk profile.
+bool SaveState(const Chip8 &chip, const char *filename);
+bool LoadState(Chip8 &chip, const char *filename);
+
+// Rewind history: one snapshot per Push, each stored as the XOR with the
+// next one, run-length encoded, so frames that change little cost a few
+// words. The oldest snapshots are dropped to stay within the byte budget.
+class RewindBuffer {
+public:
+    explicit RewindBuffer(size_t budget);
+
+    // Snapshot the machine, typically once per frame
+    void Push(const Chip8 &chip);
+    // Restore the snapshot before the last one pushed or rewound to, and
+    // drop the latter. Returns false once there is nothing older.
+    bool Rewind(Chip8 &chip);
+
+    size_t Snapshots() const { return deltas.size(); }
+    size_t Bytes() const { return bytes; }
+
+private:
+    size_t budget;
+    size_t bytes{};
+    bool empty{true};
+    StateImage latest;  // The newest snapshot, in full
+    StateImage current; // Scratch for the one being pushed
+    std::deque<std::vector<uint64_t>> deltas; // Oldest first
+};
+
+#endif // CHIP_8_SAVESTATE_H
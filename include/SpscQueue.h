@@ -0,0 +1,41 @@
+#ifndef CHIP_8_SPSCQUEUE_H
+#define CHIP_8_SPSCQUEUE_H
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue between exactly one producer and one consumer
+// thread: a ring of `Capacity` slots (a power of two) with a head only the
+// consumer moves and a tail only the producer moves.
+template <typename T, size_t Capacity> class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0);
+
+public:
+    // Producer: false if the queue is full
+    bool Push(const T &value) {
+        const size_t at = tail.load(std::memory_order_relaxed);
+        if (at - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots[at & (Capacity - 1)] = value;
+        tail.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: false if the queue is empty
+    bool Pop(T &value) {
+        const size_t at = head.load(std::memory_order_relaxed);
+        if (at == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[at & (Capacity - 1)];
+        head.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T slots[Capacity]{};
+    alignas(64) std::atomic<size_t> head{};
+    alignas(64) std::atomic<size_t> tail{};
+};
+
+#endif // CHIP_8_SPSCQUEUE_H
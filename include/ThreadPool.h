@@ -0,0 +1,37 @@
+#ifndef CHIP_8_THREADPOOL_H
+#define CHIP_8_THREADPOOL_H
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs a fixed set of tasks on a work-stealing pool. Tasks are dealt out
+// round-robin; each worker drains its own deque from the back and, once it
+// is empty, steals from the front of the others, so long jobs don't leave
+// the remaining cores idle behind them.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    // 0 = one worker per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+
+    // Run every task and return once all have finished
+    void Run(std::vector<Task> tasks);
+
+    unsigned Threads() const { return static_cast<unsigned>(queues.size()); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void Work(unsigned self);
+    bool Pop(unsigned self, Task &task);
+    bool Steal(unsigned self, Task &task);
+
+    std::vector<Queue> queues; // One per worker
+};
+
+#endif // CHIP_8_THREADPOOL_H
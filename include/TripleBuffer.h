@@ -0,0 +1,41 @@
+#ifndef CHIP_8_TRIPLEBUFFER_H
+#define CHIP_8_TRIPLEBUFFER_H
+#include <atomic>
+#include <cstdint>
+
+// Lock-free handoff of the latest value from one writer thread to one reader
+// thread. The writer fills a back slot and publishes it by swapping it with
+// the middle one; the reader swaps the middle slot for its front one when a
+// newer value is there. Neither side ever waits, and a reader that falls
+// behind skips straight to the newest value.
+template <typename T> class TripleBuffer {
+public:
+    // Writer: the slot to fill, then Publish it
+    T &Back() { return slots[back]; }
+    void Publish() {
+        back = middle.exchange(back | kFresh, std::memory_order_acq_rel) &
+               kIndex;
+    }
+
+    // Reader: take the newest published value, false if there is none since
+    // the last call. Front() stays valid until the next Update.
+    bool Update() {
+        if (!(middle.load(std::memory_order_relaxed) & kFresh)) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+    const T &Front() const { return slots[front]; }
+
+private:
+    static constexpr uint8_t kIndex = 3;
+    static constexpr uint8_t kFresh = 4; // Middle slot not yet read
+
+    T slots[3]{};
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back{0};  // Writer's
+    alignas(64) uint8_t front{2}; // Reader's
+};
+
+#endif // CHIP_8_TRIPLEBUFFER_H
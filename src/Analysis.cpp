@@ -0,0 +1,294 @@
+#include "Analysis.h"
+#include "Chip8.h"
+#include "Opcodes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+
+// Cache file layout, integers little-endian:
+//   "C8AN", version (1 byte), profile (1), 2 reserved, program hash (8),
+//   the instruction and leader bitmaps (a bit per byte of the profile's
+//   memory, address i in bit i % 8 of byte i / 8), then the idle loops and
+//   the computed jumps, each as a count (2) followed by that many addresses
+//   (2 each).
+namespace {
+constexpr char kMagic[4] = {'C', '8', 'A', 'N'};
+constexpr uint8_t kVersion = 2; // 2: SUPER-CHIP and XO-CHIP instructions
+
+void PutFixed(std::string &out, uint64_t value, const int bytes) {
+    for (auto i = 0; i < bytes; i++, value >>= 8) {
+        out.push_back(static_cast<char>(value & 0xFF));
+    }
+}
+
+void PutBits(std::string &out, const std::bitset<0x10000> &bits,
+             const size_t size) {
+    for (size_t byte = 0; byte < size / 8; byte++) {
+        uint8_t value = 0;
+        for (auto bit = 0; bit < 8; bit++) {
+            value |= bits[byte * 8 + bit] << bit;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+}
+
+void PutAddresses(std::string &out, const std::vector<uint16_t> &addresses) {
+    PutFixed(out, addresses.size(), 2);
+    for (const auto address : addresses) {
+        PutFixed(out, address, 2);
+    }
+}
+
+// Reads from a loaded file, throwing if it ends early
+class Reader {
+public:
+    explicit Reader(const std::string &data) : data(data) {}
+
+    uint64_t Fixed(const int bytes) {
+        if (data.size() - at < static_cast<size_t>(bytes)) {
+            throw std::runtime_error("truncated");
+        }
+        uint64_t value = 0;
+        for (auto i = 0; i < bytes; i++) {
+            value |= uint64_t{static_cast<uint8_t>(data[at++])} << 8 * i;
+        }
+        return value;
+    }
+    void Bits(std::bitset<0x10000> &bits, const size_t size) {
+        for (size_t byte = 0; byte < size / 8; byte++) {
+            const auto value = Fixed(1);
+            for (auto bit = 0; bit < 8; bit++) {
+                bits[byte * 8 + bit] = value >> bit & 1;
+            }
+        }
+    }
+    void Addresses(std::vector<uint16_t> &addresses, const size_t size) {
+        addresses.resize(Fixed(2));
+        for (auto &address : addresses) {
+            address = static_cast<uint16_t>(Fixed(2) & (size - 1));
+        }
+    }
+    bool AtEnd() const { return at == data.size(); }
+
+private:
+    const std::string &data;
+    size_t at{};
+};
+} // namespace
+
+Analysis Analyze(const Chip8 &chip) {
+    Analysis analysis;
+    std::vector<uint16_t> pending;
+    // Queue `address` once. Instructions run past the end of memory only as
+    // far as the last full opcode.
+    const uint32_t end = chip.memory.Size() - 1;
+    const auto reach = [&](const uint32_t address, const bool leader) {
+        if (address >= end) {
+            return;
+        }
+        if (leader) {
+            analysis.leaders.set(address);
+        }
+        if (!analysis.instructions[address]) {
+            analysis.instructions.set(address);
+            pending.push_back(address);
+        }
+    };
+    reach(chip.memory.Wrap(chip.pc), true);
+
+    // Successors as the engines see them: whatever reads or changes pc, or
+    // may overwrite code, ends a block, so what follows it starts one
+    WithQuirks(chip.profile, [&]<typename Quirks>(Quirks) {
+        // A skip passes over F000 nnnn whole (XO-CHIP)
+        const auto skipped = [&](const uint32_t next) {
+            const bool wide =
+                Quirks::extensions == Extensions::XoChip &&
+                chip.memory[next] == 0xF0 && chip.memory[next + 1] == 0x00;
+            return next + (wide ? 4 : 2);
+        };
+
+        while (!pending.empty()) {
+            const uint16_t address = pending.back();
+            pending.pop_back();
+            Instruction i = Decode<Quirks>((chip.memory[address] << 8) |
+                                           chip.memory[address + 1]);
+            MarkIdleLoop(i, chip, address);
+
+            const auto h = i.handler;
+            const uint32_t next = address + 2;
+            if (h == Op1nnnSelf || h == Op1nnnDelayPoll) {
+                analysis.idle_loops.push_back(address);
+                reach(i.nnn, true);
+            } else if (h == Op1nnn) {
+                reach(i.nnn, true);
+            } else if (h == Op2nnn) {
+                reach(i.nnn, true);
+                reach(next, true);
+            } else if (h == Op3xkk<Quirks> || h == Op4xkk<Quirks> ||
+                       h == Op5xy0<Quirks> || h == Op9xy0<Quirks> ||
+                       h == OpEx9E<Quirks> || h == OpExA1<Quirks>) {
+                reach(next, true);
+                reach(skipped(next), true);
+            } else if ((i.opcode & 0xF000) == 0xB000) {
+                analysis.computed_jumps.push_back(address);
+            } else if (h == OpF000) {
+                reach(next + 2, true);
+            } else if (h == OpFx0A || h == OpFx33 || h == Op5xy2 ||
+                       (i.opcode & 0xF0FF) == 0xF055) {
+                reach(next, true);
+            } else if (h != Op00EE && h != OpUnknown && h != Op00FD) {
+                reach(next, false);
+            }
+        }
+    });
+
+    std::sort(analysis.idle_loops.begin(), analysis.idle_loops.end());
+    std::sort(analysis.computed_jumps.begin(), analysis.computed_jumps.end());
+    return analysis;
+}
+
+AnalysisCache::AnalysisCache(std::string directory)
+    : directory(std::move(directory)) {
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+    if (error) {
+        std::cerr << "Error: Could not create directory " << this->directory
+                  << ", analyses will not be kept" << std::endl;
+    }
+}
+
+std::shared_ptr<const Analysis> AnalysisCache::Get(const Chip8 &chip) {
+    const uint64_t hash = chip.ProgramHash();
+    const auto key = std::make_pair(hash, chip.profile);
+    {
+        const std::lock_guard lock(mutex);
+        if (const auto found = entries.find(key); found != entries.end()) {
+            hits++;
+            return found->second.analysis;
+        }
+    }
+
+    // Workers analysing the same program at once each do so; the first to
+    // finish is kept
+    char name[40];
+    std::snprintf(name, sizeof(name), "/%016llx-%s.c8an",
+                  static_cast<unsigned long long>(hash),
+                  ProfileName(chip.profile));
+    const std::string filename = directory + name;
+    auto analysis = Load(filename, hash, chip.profile);
+    const auto found = analysis != nullptr;
+    if (!found) {
+        auto fresh = std::make_shared<Analysis>(Analyze(chip));
+        Store(filename, hash, chip.profile, *fresh);
+        analysis = std::move(fresh);
+    }
+
+    const std::lock_guard lock(mutex);
+    if (found) {
+        hits++;
+    } else {
+        misses++;
+    }
+    auto &entry = entries[key];
+    if (!entry.analysis) {
+        entry.analysis = std::move(analysis);
+    }
+    return entry.analysis;
+}
+
+std::shared_ptr<const Chip8> AnalysisCache::Prepared(const Chip8 &chip) {
+    const auto key = std::make_pair(chip.ProgramHash(), chip.profile);
+    const auto engine = static_cast<int>(chip.engine);
+    {
+        const std::lock_guard lock(mutex);
+        if (const auto found = entries.find(key);
+            found != entries.end() && found->second.prepared[engine]) {
+            hits++;
+            return found->second.prepared[engine];
+        }
+    }
+
+    const auto analysis = Get(chip);
+    auto prepared = std::make_shared<Chip8>(chip.Fork());
+    prepared->Prewarm(*analysis);
+
+    const std::lock_guard lock(mutex);
+    auto &entry = entries[key];
+    if (!entry.prepared[engine]) {
+        entry.prepared[engine] = std::move(prepared);
+    }
+    return entry.prepared[engine];
+}
+
+// A stored analysis, or nullptr if there is none or it doesn't match
+std::shared_ptr<const Analysis>
+AnalysisCache::Load(const std::string &filename, const uint64_t hash,
+                    const Profile profile) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return nullptr;
+    }
+    const std::string data(std::istreambuf_iterator<char>(file), {});
+
+    try {
+        Reader in(data);
+        for (const char c : kMagic) {
+            if (in.Fixed(1) != static_cast<uint8_t>(c)) {
+                return nullptr;
+            }
+        }
+        if (in.Fixed(1) != kVersion ||
+            in.Fixed(1) != static_cast<uint8_t>(profile)) {
+            return nullptr;
+        }
+        in.Fixed(2);
+        if (in.Fixed(8) != hash) {
+            return nullptr;
+        }
+        const size_t size = MemorySize(profile);
+        auto analysis = std::make_shared<Analysis>();
+        in.Bits(analysis->instructions, size);
+        in.Bits(analysis->leaders, size);
+        in.Addresses(analysis->idle_loops, size);
+        in.Addresses(analysis->computed_jumps, size);
+        return in.AtEnd() ? analysis : nullptr;
+    } catch (const std::runtime_error &) {
+        return nullptr; // Analysed again and overwritten
+    }
+}
+
+// Written under a unique name and renamed into place, so readers in other
+// processes never see a partial file
+void AnalysisCache::Store(const std::string &filename, const uint64_t hash,
+                          const Profile profile, const Analysis &analysis) {
+    std::string out(kMagic, sizeof(kMagic));
+    PutFixed(out, kVersion, 1);
+    PutFixed(out, static_cast<uint8_t>(profile), 1);
+    PutFixed(out, 0, 2);
+    PutFixed(out, hash, 8);
+    PutBits(out, analysis.instructions, MemorySize(profile));
+    PutBits(out, analysis.leaders, MemorySize(profile));
+    PutAddresses(out, analysis.idle_loops);
+    PutAddresses(out, analysis.computed_jumps);
+
+    const std::string temporary =
+        filename + "." + std::to_string(std::random_device{}());
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file.write(out.data(),
+                        static_cast<std::streamsize>(out.size()))) {
+            return; // Not kept, analysed again next time
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, filename, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+    }
+}
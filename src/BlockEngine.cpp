@@ -0,0 +1,378 @@
+#include "BlockEngine.h"
+#include "Opcodes.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+constexpr size_t kMaxBlockLength = 32;
+
+// Threaded-code tokens are indices into this table. Execute() holds the
+// matching label table, which must list the handlers in the same order.
+template <typename Quirks>
+constexpr Instruction::Handler kHandlers[] = {
+    Op0nnn,         Op00E0,         Op00EE,         Op1nnn,
+    Op2nnn,         Op3xkk<Quirks>, Op4xkk<Quirks>, Op5xy0<Quirks>,
+    Op6xkk,         Op7xkk,         Op8xy0,         Op8xy1<Quirks>,
+    Op8xy2<Quirks>, Op8xy3<Quirks>, Op8xy4,         Op8xy5,
+    Op8xy6<Quirks>, Op8xy7,         Op8xyE<Quirks>, Op9xy0<Quirks>,
+    OpAnnn,         OpBnnn<Quirks>, OpCxkk,         OpDxyn<Quirks>,
+    OpEx9E<Quirks>, OpExA1<Quirks>, OpFx07,         OpFx0A,
+    OpFx15,         OpFx18,         OpFx1E,         OpFx29,
+    OpFx33,         OpFx55<Quirks>, OpFx65<Quirks>, OpUnknown,
+    Op1nnnSelf,     Op1nnnDelayPoll,
+};
+constexpr uint8_t kExitToken = std::size(kHandlers<Modern>);
+
+// Superinstructions: one token running a whole sequence of instructions,
+// whose operands sit in the ops that follow it
+constexpr uint8_t kLoadRunToken = kExitToken + 1;   // 6xkk, 6xkk, ...
+constexpr uint8_t kLoadDrawToken = kExitToken + 2;  // Annn, Dxyn
+constexpr uint8_t kDelayPollToken = kExitToken + 3; // Fx07, 3xkk, 1nnn
+// SUPER-CHIP and XO-CHIP instructions, called through their handler
+constexpr uint8_t kCallToken = kExitToken + 4;
+
+template <typename Quirks>
+uint8_t TokenFor(const Instruction::Handler handler) {
+    const auto &handlers = kHandlers<Quirks>;
+    const auto found =
+        std::find(std::begin(handlers), std::end(handlers), handler);
+    return found == std::end(handlers) ? kCallToken
+                                       : found - std::begin(handlers);
+}
+
+// Instructions that read or change pc, or write memory that may hold code,
+// end a basic block.
+template <typename Quirks>
+bool EndsBlock(const Instruction::Handler handler) {
+    return handler == Op00EE || handler == Op1nnn || handler == Op2nnn ||
+           handler == Op3xkk<Quirks> || handler == Op4xkk<Quirks> ||
+           handler == Op5xy0<Quirks> || handler == Op9xy0<Quirks> ||
+           handler == OpBnnn<Quirks> || handler == OpEx9E<Quirks> ||
+           handler == OpExA1<Quirks> || handler == OpFx0A ||
+           handler == OpFx33 || handler == OpFx55<Quirks> ||
+           handler == OpUnknown || handler == Op1nnnSelf ||
+           handler == Op1nnnDelayPoll || handler == Op00FD ||
+           handler == Op5xy2 || handler == OpF000;
+}
+} // namespace
+
+BlockEngine::BlockEngine(const size_t size)
+    : mask(static_cast<uint16_t>(size - 1)), blocks(size), code(size) {}
+
+void BlockEngine::Run(Chip8 &chip) {
+    // Pick the specialization once per call, never per instruction
+    WithQuirks(chip.profile,
+               [&]<typename Quirks>(Quirks) { Run<Quirks>(chip); });
+}
+
+template <typename Quirks> void BlockEngine::Run(Chip8 &chip) {
+    while (chip.budget) {
+        if (!retired.empty()) {
+            retired.clear();
+        }
+
+        const Block *block = nullptr;
+        if (chip.pc < mask) {
+            block = blocks[chip.pc] ? blocks[chip.pc]
+                                    : Translate<Quirks>(chip, chip.pc);
+        }
+
+        if (!block || block->cycles > chip.budget) {
+            // Not enough budget left for the whole block (or pc is outside
+            // memory): finish one instruction at a time
+            chip.budget--;
+            chip.HandleOpcode();
+            continue;
+        }
+
+        // Charged up front, like the interpreter, so idle loop handlers can
+        // fast-forward what is left
+        chip.budget -= block->cycles;
+        Execute<Quirks>(chip, *block);
+    }
+}
+
+void BlockEngine::Prewarm(const Chip8 &chip,
+                          const std::bitset<0x10000> &leaders) {
+    WithQuirks(chip.profile, [&]<typename Quirks>(Quirks) {
+        for (auto start = 0; start < mask; start++) {
+            if (leaders[start] && !blocks[start]) {
+                Translate<Quirks>(chip, start);
+            }
+        }
+    });
+}
+
+void BlockEngine::Invalidate(const uint16_t address, const size_t length) {
+    bool overwritten = false;
+    for (size_t i = 0; i < length && !overwritten; i++) {
+        overwritten = code[(address + i) & mask];
+    }
+    if (!overwritten) {
+        return;
+    }
+
+    // Code changed: drop every block overlapping the written bytes. The
+    // running block may be one of them, so keep it alive until Run resumes.
+    const size_t first = address & mask;
+    const size_t last = first + length;
+    std::erase_if(translated, [&](std::shared_ptr<const Block> &block) {
+        if (block->low < last && first < block->end) {
+            blocks[block->start] = nullptr;
+            retired.push_back(std::move(block));
+            return true;
+        }
+        return false;
+    });
+
+    code.assign(code.size(), false);
+    for (const auto &block : translated) {
+        for (uint32_t a = block->low; a < block->end; a++) {
+            code[a] = true;
+        }
+    }
+}
+
+template <typename Quirks>
+const BlockEngine::Block *BlockEngine::Translate(const Chip8 &chip,
+                                                 const uint16_t start) {
+    auto block = std::make_unique<Block>();
+    block->start = start;
+    block->low = start;
+
+    // Opcodes are 16 bits long: merge 2 bytes
+    const auto decode = [&](const uint16_t address) {
+        Instruction instruction =
+            Decode<Quirks>((chip.memory[address] << 8) |
+                           chip.memory[address + 1]);
+        MarkIdleLoop(instruction, chip, address & mask);
+        if (instruction.handler == Op1nnnDelayPoll) {
+            // Also depends on the Fx07 / 3xkk it jumps back to
+            block->low = std::min<uint16_t>(block->low, instruction.nnn);
+        }
+        return instruction;
+    };
+
+    // Wider than an address, so a block can end at the top of 64K memory
+    uint32_t address = start;
+    uint16_t cycles = 0;
+    for (;;) {
+        const Instruction instruction = decode(address);
+        const size_t first = block->ops.size();
+        block->ops.push_back(
+            {TokenFor<Quirks>(instruction.handler), 1, instruction});
+
+        // Peephole: fold common sequences into one superinstruction
+        if (instruction.handler == Op6xkk) {
+            while (address + 2 * block->ops[first].length < mask &&
+                   cycles + block->ops[first].length < kMaxBlockLength) {
+                const Instruction next =
+                    decode(address + 2 * block->ops[first].length);
+                if (next.handler != Op6xkk) {
+                    break;
+                }
+                block->ops.push_back({kLoadRunToken, 0, next});
+                block->ops[first].length++;
+            }
+            if (block->ops[first].length > 1) {
+                block->ops[first].token = kLoadRunToken;
+            }
+        } else if (instruction.handler == OpAnnn && address + 2 < mask) {
+            if (const Instruction next = decode(address + 2);
+                next.handler == OpDxyn<Quirks>) {
+                block->ops[first] = {kLoadDrawToken, 2, instruction};
+                block->ops.push_back({kLoadDrawToken, 0, next});
+            }
+        } else if (instruction.handler == OpFx07 && address + 4 < mask) {
+            const Instruction skip = decode(address + 2);
+            const Instruction jump = decode(address + 4);
+            if (skip.handler == Op3xkk<Quirks> && skip.x == instruction.x &&
+                (jump.opcode & 0xF000) == 0x1000) {
+                block->ops[first] = {kDelayPollToken, 3, instruction};
+                block->ops.push_back({kDelayPollToken, 0, skip});
+                block->ops.push_back({kDelayPollToken, 0, jump});
+            }
+        }
+
+        const Op &op = block->ops[first];
+        const Instruction &last = block->ops.back().instruction;
+        address += 2 * op.length;
+        cycles += op.length;
+
+        if (op.token == kDelayPollToken || EndsBlock<Quirks>(last.handler) ||
+            cycles >= kMaxBlockLength || address >= mask) {
+            break;
+        }
+    }
+
+    block->end = address;
+    block->cycles = cycles;
+    block->ops.push_back({kExitToken, 1, {}});
+
+    for (uint32_t a = block->low; a < address; a++) {
+        code[a] = true;
+    }
+    blocks[start] = block.get();
+    translated.push_back(std::move(block));
+    return blocks[start];
+}
+
+template <typename Quirks>
+void BlockEngine::Execute(Chip8 &chip, const Block &block) {
+    // Computed goto (GCC/Clang): every op jumps straight to the next one
+    static const void *const labels[] = {
+        &&op_0nnn, &&op_00E0, &&op_00EE, &&op_1nnn, &&op_2nnn, &&op_3xkk,
+        &&op_4xkk, &&op_5xy0, &&op_6xkk, &&op_7xkk, &&op_8xy0, &&op_8xy1,
+        &&op_8xy2, &&op_8xy3, &&op_8xy4, &&op_8xy5, &&op_8xy6, &&op_8xy7,
+        &&op_8xyE, &&op_9xy0, &&op_Annn, &&op_Bnnn, &&op_Cxkk, &&op_Dxyn,
+        &&op_Ex9E, &&op_ExA1, &&op_Fx07, &&op_Fx0A, &&op_Fx15, &&op_Fx18,
+        &&op_Fx1E, &&op_Fx29, &&op_Fx33, &&op_Fx55, &&op_Fx65, &&op_unknown,
+        &&op_1nnn_self, &&op_1nnn_delay_poll, &&exit, &&load_run, &&load_draw,
+        &&delay_poll, &&call,
+    };
+    static_assert(std::size(labels) == kCallToken + 1);
+
+    // Only an instruction that ends a block reads or changes pc, and it is
+    // always the last one, so pc can be set for the whole block up front.
+    chip.pc = block.end;
+    chip.opcode = block.ops[block.ops.size() - 2].instruction.opcode;
+
+    const Op *op = block.ops.data();
+    // Each instruction has a slot, fused or not, so a slot's address follows
+    // from its position
+#define PROFILE(slot)                                                          \
+    if constexpr (kProfiling) {                                                \
+        if (chip.profiler) {                                                   \
+            chip.profiler->Count(                                              \
+                block.start + 2 * ((slot) - block.ops.data()),                 \
+                (slot)->instruction.opcode);                                   \
+        }                                                                      \
+    }
+#define DISPATCH(handler)                                                      \
+    PROFILE(op);                                                               \
+    handler(chip, op->instruction);                                            \
+    goto *labels[(++op)->token]
+#define DISPATCH_NEXT()                                                        \
+    op += op->length;                                                          \
+    goto *labels[op->token]
+
+    goto *labels[op->token];
+op_0nnn:
+    DISPATCH(Op0nnn);
+op_00E0:
+    DISPATCH(Op00E0);
+op_00EE:
+    DISPATCH(Op00EE);
+op_1nnn:
+    DISPATCH(Op1nnn);
+op_2nnn:
+    DISPATCH(Op2nnn);
+op_3xkk:
+    DISPATCH(Op3xkk<Quirks>);
+op_4xkk:
+    DISPATCH(Op4xkk<Quirks>);
+op_5xy0:
+    DISPATCH(Op5xy0<Quirks>);
+op_6xkk:
+    DISPATCH(Op6xkk);
+op_7xkk:
+    DISPATCH(Op7xkk);
+op_8xy0:
+    DISPATCH(Op8xy0);
+op_8xy1:
+    DISPATCH(Op8xy1<Quirks>);
+op_8xy2:
+    DISPATCH(Op8xy2<Quirks>);
+op_8xy3:
+    DISPATCH(Op8xy3<Quirks>);
+op_8xy4:
+    DISPATCH(Op8xy4);
+op_8xy5:
+    DISPATCH(Op8xy5);
+op_8xy6:
+    DISPATCH(Op8xy6<Quirks>);
+op_8xy7:
+    DISPATCH(Op8xy7);
+op_8xyE:
+    DISPATCH(Op8xyE<Quirks>);
+op_9xy0:
+    DISPATCH(Op9xy0<Quirks>);
+op_Annn:
+    DISPATCH(OpAnnn);
+op_Bnnn:
+    DISPATCH(OpBnnn<Quirks>);
+op_Cxkk:
+    DISPATCH(OpCxkk);
+op_Dxyn:
+    DISPATCH(OpDxyn<Quirks>);
+op_Ex9E:
+    DISPATCH(OpEx9E<Quirks>);
+op_ExA1:
+    DISPATCH(OpExA1<Quirks>);
+op_Fx07:
+    DISPATCH(OpFx07);
+op_Fx0A:
+    DISPATCH(OpFx0A);
+op_Fx15:
+    DISPATCH(OpFx15);
+op_Fx18:
+    DISPATCH(OpFx18);
+op_Fx1E:
+    DISPATCH(OpFx1E);
+op_Fx29:
+    DISPATCH(OpFx29);
+op_Fx33:
+    DISPATCH(OpFx33);
+op_Fx55:
+    DISPATCH(OpFx55<Quirks>);
+op_Fx65:
+    DISPATCH(OpFx65<Quirks>);
+op_unknown:
+    DISPATCH(OpUnknown);
+op_1nnn_self:
+    DISPATCH(Op1nnnSelf);
+op_1nnn_delay_poll:
+    DISPATCH(Op1nnnDelayPoll);
+exit:
+    return;
+load_run:
+    fusions.load_runs++;
+    for (auto i = 0; i < op->length; i++) {
+        PROFILE(op + i);
+        Op6xkk(chip, op[i].instruction);
+    }
+    DISPATCH_NEXT();
+load_draw:
+    fusions.load_draws++;
+    PROFILE(op);
+    PROFILE(op + 1);
+    OpAnnn(chip, op[0].instruction);
+    OpDxyn<Quirks>(chip, op[1].instruction);
+    DISPATCH_NEXT();
+delay_poll:
+    // Always last in its block, so pc is already past the 1nnn: a taken
+    // skip leaves it there and runs one instruction less
+    fusions.delay_polls++;
+    PROFILE(op);
+    PROFILE(op + 1);
+    OpFx07(chip, op[0].instruction);
+    if (chip.v[op[0].instruction.x] == op[1].instruction.kk) {
+        chip.opcode = op[1].instruction.opcode;
+        chip.budget++;
+        return;
+    }
+    PROFILE(op + 2);
+    if (op[2].instruction.handler == Op1nnnDelayPoll) {
+        Op1nnnDelayPoll(chip, op[2].instruction);
+    } else {
+        Op1nnn(chip, op[2].instruction);
+    }
+    return;
+call:
+    DISPATCH(op->instruction.handler);
+#undef DISPATCH_NEXT
+#undef DISPATCH
+#undef PROFILE
+}
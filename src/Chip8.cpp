@@ -1,370 +1,225 @@
 #include "Chip8.h"
-
-#include <fstream>
-#include <ios>
+#include "Analysis.h"
+#include "BlockEngine.h"
+#include "Debugger.h"
+#include "MappedFile.h"
+#include "Opcodes.h"
+#include "Profiler.h"
+
+#include <algorithm>
 #include <iosfwd>
 #include <iostream>
-#include <ncurses.h>
-#include <random>
-#include <sstream>
-#include <stdexcept>
 #include <string>
 
-Chip8::Chip8() {
-    pc = 0x200; // 0x000 to 0x1FF are reserved for the interpreter
-    for (auto i = 80; i--;) {
-        memory[0x50 + i] = font_set[i];
-    }
+namespace {
+// Memory at power-on: the font at 0x50, with SUPER-CHIP and XO-CHIP the big
+// font at 0xA0, zeros elsewhere. Every machine starts out sharing its pages.
+const CowPages<uint8_t> &BootMemory(const Profile profile) {
+    const auto boot = [](const size_t size, const bool big_font) {
+        CowPages<uint8_t> memory(size);
+        memory.Write(0x50, Chip8::font_set, sizeof(Chip8::font_set));
+        if (big_font) {
+            memory.Write(0xA0, Chip8::big_font_set,
+                         sizeof(Chip8::big_font_set));
+        }
+        return memory;
+    };
+    static const auto chip8 = boot(0x1000, false);
+    static const auto super_chip = boot(0x1000, true);
+    static const auto xo_chip = boot(0x10000, true);
+    return WithQuirks(profile, [&]<typename Quirks>(Quirks) -> const auto & {
+        switch (Quirks::extensions) {
+            case Extensions::SuperChip:
+                return super_chip;
+            case Extensions::XoChip:
+                return xo_chip;
+            default:
+                return chip8;
+        }
+    });
 }
+} // namespace
 
-bool Chip8::LoadROM(char const *filename) {
-    // Read file in binary mode and start the pointer in the end
-    if (std::ifstream file(filename, std::ios::binary | std::ios::ate);
-        file.is_open()) {
+Chip8::Chip8(const Profile profile)
+    : memory(BootMemory(profile)), gfx(ExtendedDisplay(profile)),
+      decoded(MemorySize(profile)), profile(profile) {
+    pc = 0x200; // 0x000 to 0x1FF are reserved for the interpreter
+}
 
-        // Read pointer location to find file size
-        const std::streamsize size = file.tellg();
+Chip8::Chip8(Chip8 &&) noexcept = default;
+Chip8 &Chip8::operator=(Chip8 &&) noexcept = default;
+Chip8::~Chip8() = default;
+
+// Everything but the profiler and debugger. Translated blocks are shared like
+// pages.
+Chip8::Chip8(const Chip8 &parent)
+    : draw_flag(parent.draw_flag), stop_flag(parent.stop_flag),
+      memory(parent.memory), index(parent.index), pc(parent.pc),
+      sp(parent.sp), gfx(parent.gfx), plane_mask(parent.plane_mask),
+      opcode(parent.opcode), decoded(parent.decoded), pitch(parent.pitch),
+      idle(parent.idle), cycles(parent.cycles), clock_hz(parent.clock_hz),
+      tick(parent.tick), delay_expiry(parent.delay_expiry),
+      sound_expiry(parent.sound_expiry), sound_playing(parent.sound_playing),
+      keypad(parent.keypad), rng(parent.rng), profile(parent.profile),
+      engine(parent.engine),
+      block_engine(parent.block_engine
+                       ? std::make_unique<BlockEngine>(*parent.block_engine)
+                       : nullptr) {
+    std::copy_n(parent.v, 16, v);
+    std::copy_n(parent.stack, 16, stack);
+    std::copy_n(parent.flags, 16, flags);
+    std::copy_n(parent.pattern, 16, pattern);
+}
 
-        // Make buffer of that size to place data
-        const auto buffer = new char[size];
+Chip8 Chip8::Fork() const { return Chip8(*this); }
 
-        // Move pointer back to the beginning
-        file.seekg(0, std::ios::beg);
+bool Chip8::LoadROM(char const *filename) {
+    // Map the file rather than read it: the only copy is into memory
+    MappedFile file;
+    if (!file.Open(filename)) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    if (file.Size() > MaxRomSize(profile)) {
+        std::cerr << "Error: " << filename << " is " << file.Size()
+                  << " bytes, only " << MaxRomSize(profile) << " fit"
+                  << std::endl;
+        return false;
+    }
+    return LoadROM(file.Data(), file.Size());
+}
 
-        // Read file into the buffer
-        file.read(buffer, size);
+bool Chip8::LoadROM(const uint8_t *rom, const size_t size) {
+    if (size > MaxRomSize(profile)) {
+        std::cerr << "Error: ROM is " << size << " bytes, only "
+                  << MaxRomSize(profile) << " fit" << std::endl;
+        return false;
+    }
+    memory.Write(0x200, rom, size);
 
-        // Load buffer into memory
-        for (auto i = size; i--;) {
-            memory[0x200 + i] = buffer[i];
-        }
+    // Drop anything decoded from the previous contents
+    InvalidateDecoded(0x200, size);
+    return true;
+}
 
-        // Free buffer.
-        delete[] buffer;
-        return true;
+uint64_t Chip8::ProgramHash() const {
+    uint64_t hash = 0xCBF29CE484222325;
+    for (size_t i = 0x200; i < memory.Size(); i++) {
+        hash = (hash ^ memory[i]) * 0x100000001B3;
     }
+    return hash;
+}
 
-    std::cerr << "Error: Could not open file " << filename << std::endl;
-    return false;
+void Chip8::Prewarm(const Analysis &analysis) {
+    for (size_t address = 0; address + 1 < memory.Size(); address++) {
+        if (analysis.instructions[address] && !decoded[address].handler) {
+            Instruction &entry = decoded.Mutable(address);
+            entry = Decode(profile,
+                           (memory[address] << 8) | memory[address + 1]);
+            MarkIdleLoop(entry, *this, address);
+        }
+    }
+    if (engine == Engine::Threaded) {
+        if (!block_engine) {
+            block_engine = std::make_unique<BlockEngine>(memory.Size());
+        }
+        block_engine->Prewarm(*this, analysis.leaders);
+    }
 }
 
 void Chip8::HandleOpcode() {
-    // Opcodes are 16 bits long: merge 2 bytes
-    opcode = (memory[pc] << 8) | memory[pc + 1];
+    const Instruction *instruction = &decoded[pc];
+    if (!instruction->handler) {
+        // Opcodes are 16 bits long: merge 2 bytes
+        Instruction &entry = decoded.Mutable(pc);
+        entry = Decode(profile, (memory[pc] << 8) | memory[pc + 1]);
+        MarkIdleLoop(entry, *this, memory.Wrap(pc));
+        instruction = &entry;
+    }
+    if constexpr (kProfiling) {
+        if (profiler) {
+            profiler->Count(pc, instruction->opcode);
+        }
+    }
+    opcode = instruction->opcode;
     // Increment by 2 bytes
     pc += 2;
 
-    const uint16_t nnn = opcode & 0x0FFF;
-    const uint8_t kk = opcode & 0x00FF;
-    const uint8_t x = (opcode & 0x0F00) >> 8;
-    const uint8_t y = (opcode & 0x00F0) >> 4;
-    const uint8_t n = opcode & 0x000F;
+    instruction->handler(*this, *instruction);
+}
 
-    // The Switch-Case Monolith
-    switch (opcode & 0xF000) {
-        case 0x0000: {
-            switch (kk) {
-                case 0xE0: {
-                    // 00E0: CLS (Clear the display)
-                    std::memset(gfx, 0, sizeof(gfx));
-                    draw_flag = true;
-                    break;
-                }
-                case 0xEE: {
-                    // 00EE: RET (Return from a subroutine)
-                    pc = stack[--sp];
-                    break;
-                }
-                default: {
-                    // 0nnn: SYS addr (Jump to a machine code routine at nnn)
-                    // Modern interpreters ignores this opcode.
-                    break;
-                }
-            }
-            break;
-        }
-        case 0x1000: {
-            // 1nnn: JP addr (Jump to location nnn)
-            pc = nnn;
-            break;
-        }
-        case 0x2000: {
-            // 2nnn: CALL addr (Call subroutine at nnn)
-            stack[sp++] = pc;
-            pc = nnn;
-            break;
-        }
-        case 0x3000: {
-            // 3xkk: SE Vx, byte (Skip next instruction if Vx = kk)
-            if (v[x] == kk) {
-                pc += 2;
-            }
-            break;
-        }
-        case 0x4000: {
-            // 4xkk: SNE Vx, byte (Skip next instruction if Vx != kk)
-            if (v[x] != kk) {
-                pc += 2;
-            }
-            break;
-        }
-        case 0x5000: {
-            // 5xy0 - SE Vx, Vy (Skip next instruction if Vx = Vy)
-            if (v[x] == v[y]) {
-                pc += 2;
-            }
-            break;
-        }
-        case 0x6000: {
-            // 6xkk: LD Vx, byte (Set Vx = kk)
-            v[x] = kk;
-            break;
-        }
-        case 0x7000: {
-            // 7xkk: ADD Vx, byte (Set Vx = Vx + kk)
-            v[x] += kk;
-            break;
-        }
-        case 0x8000: {
-            switch (n) {
-                case (0x0): {
-                    // 8xy0: LD Vx, Vy (Set Vx = Vy)
-                    v[x] = v[y];
-                    break;
-                }
-                case (0x1): {
-                    // 8xy1: OR Vx, Vy (Set Vx = Vx OR Vy)
-                    v[x] |= v[y];
-                    break;
-                }
-                case (0x2): {
-                    // 8xy2: AND Vx, Vy (Set Vx = Vx AND Vy)
-                    v[x] &= v[y];
-                    break;
-                }
-                case (0x3): {
-                    // 8xy3: XOR Vx, Vy (Set Vx = Vx XOR Vy)
-                    v[x] ^= v[y];
-                    break;
-                }
-                case (0x4): {
-                    // 8xy4: ADD Vx, Vy (Set Vx = Vx + Vy, set VF = carry)
-                    uint8_t val_x = v[x], val_y = v[y];
-                    uint16_t sum = val_x + val_y;
-                    v[x] = sum & 0xFF;
-                    v[0xF] = sum > 0xFF;
-                    break;
-                }
-                case (0x5): {
-                    // 8xy5: SUB Vx, Vy (Set Vx = Vx - Vy, set VF = NOT borrow)
-                    uint8_t val_y = v[y], val_x = v[x];
-                    v[x] = val_x - val_y;
-                    v[0xF] = val_x >= val_y;
-                    break;
-                }
-                case (0x6): {
-                    // 8xy6: SHR Vx {, Vy} (Set Vx = Vx SHR 1, set VF to the
-                    // least significant bit of Vx before shift
-                    // TODO: Config for quirk
-                    bool quirk_8xy6 =
-                        true; // TRUE for vX = vY >> 1, FALSE for vX = vX >> 1
-                    uint8_t val = quirk_8xy6 ? v[y] : v[x];
-                    v[x] = val >> 1;
-                    v[0xF] = val & 0x01;
-                    break;
-                }
-                case (0x7): {
-                    // 8xy7: SUBN Vx, Vy (Set Vx = Vy - Vx, set VF = NOT borrow)
-                    uint8_t val_y = v[y], val_x = v[x];
-                    v[x] = val_y - val_x;
-                    v[0xF] = val_y >= val_x;
-                    break;
-                }
-                case (0xE): {
-                    // 8xyE: SHL Vx {, Vy} (Set Vx = Vx SHL 1, set VF to the
-                    // most significant bit of Vx before shift)
-                    bool quirk_8xyE =
-                        true; // TRUE for vX = vY >> 1, FALSE for vX = vX >> 1
-                    uint8_t val = quirk_8xyE ? v[y] : v[x];
-                    v[x] = (val << 1) & 0xFF;
-                    v[0xF] = (val & 0x80) >> 7;
-                    break;
-                }
-                default: {
-                    std::stringstream ss;
-                    ss << "Unknown opcode [0x8000 family]: 0x" << std::hex
-                       << opcode;
-                    throw std::runtime_error(ss.str());
-                }
-            }
-            break;
-        }
-        case 0x9000: {
-            // 9xy0: SNE Vx, Vy (Skip next instruction if Vx != Vy)
-            if (v[x] != v[y]) {
-                pc += 2;
+// Run a batch of cycles. Idle loops are fast-forwarded (see Opcodes.h), so
+// every cycle of the batch has elapsed on return even if fewer executed.
+// A debugger with anything to do runs in place of the engine; otherwise it
+// costs one check per timer tick.
+uint64_t Chip8::RunCycles(const uint64_t count) {
+    if (engine == Engine::Threaded && !block_engine) {
+        block_engine = std::make_unique<BlockEngine>(memory.Size());
+    }
+
+    const uint64_t start = cycles;
+    const uint64_t end = cycles + count;
+    while (cycles < end) {
+        // Timers only change on tick boundaries, so run up to the next one
+        // with `tick` fixed
+        const uint64_t next_tick = ((tick + 1) * clock_hz + 59) / 60;
+        const uint64_t stop = std::min(end, next_tick);
+        budget = stop - cycles;
+        idle = Idle::None;
+
+        if (debugger && debugger->Active()) {
+            debugger->Run(*this);
+        } else if (block_engine && engine == Engine::Threaded) {
+            block_engine->Run(*this);
+        } else {
+            while (budget) {
+                budget--;
+                HandleOpcode();
             }
-            break;
         }
-        case 0xA000: {
-            // Annn: LD I, addr (Set I = nnn)
-            index = nnn;
-            break;
-        }
-        case 0xB000: {
-            // Bnnn : JP V0, addr (Jump to location nnn + V0)
-            pc = nnn + v[0x0];
+
+        // Stopped by the debugger: only what ran has elapsed
+        if (idle == Idle::Break) {
+            cycles = stop - budget;
+            tick = cycles * 60 / clock_hz;
             break;
         }
-        case 0xC000: {
-            // Cxkk: RND Vx, byte (Set Vx = random byte AND kk)
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_int_distribution<int> dist(0x00, 0xFF);
-            v[x] = dist(gen) & kk;
+        // Waiting for a key or halted: stays that way for the whole batch
+        cycles = idle == Idle::Key || idle == Idle::Halt ? end : stop;
+        tick = cycles * 60 / clock_hz;
+        if (cycles == end) {
             break;
         }
-        case 0xD000: {
-            // Dxyn: DRW Vx, Vy, nibble (Display n-byte sprite starting at
-            // memory location I at (Vx, Vy), set VF = collision.)
-
-            v[0xF] = 0; // Set VF to 0
-
-            for (auto row = 0; row < n; row++) {
-
-                const uint8_t sprite = memory[index + row];
-
-                for (auto col = 0; col < 8; col++) {
-                    // 0x80 is 1000 0000, col = 0 -> checks leftmost
-                    if (sprite & (0x80 >> col)) {
-
-                        const auto screenX = (v[x] + col) % 64; // Wrap
-                        const auto screenY = (v[y] + row) % 32; // Also wrap
-
-                        if (gfx[screenX][screenY] == 1) {
-                            v[0xF] = 1; // Collision! Set VF to 1
-                        }
+    }
+    return cycles - start;
+}
 
-                        // XOR: 0 ^ 0 = 0, 0 ^ 1 = 1, 1 ^ 0 = 1, 1 ^ 1 = 0
-                        gfx[screenX][screenY] ^= 1;
-                    }
-                }
-            }
+// Returns true once after the sound timer has run out
+bool Chip8::SoundEnded() {
+    if (sound_playing && SoundTimer() == 0) {
+        sound_playing = false;
+        return true;
+    }
+    return false;
+}
 
-            draw_flag = true;
-            break;
-        }
-        case 0xE000: {
-            switch (kk) {
-                case 0x9E: {
-                    // Ex9E: SKP Vx (Skip next instruction if key with the value
-                    // of Vx is pressed)
-                    if (keypad[v[x]]) {
-                        pc += 2;
-                    }
-                    break;
-                }
-                case 0xA1: {
-                    // ExA1: SKNP Vx (Skip next instruction if key with the
-                    // value of Vx is not pressed)
-                    if (!keypad[v[x]]) {
-                        pc += 2;
-                    }
-                    break;
-                }
-                default: {
-                    std::stringstream ss;
-                    ss << "Unknown opcode [0xE000 family]: 0x" << std::hex
-                       << opcode;
-                    throw std::runtime_error(ss.str());
-                }
-            }
-            break;
-        }
-        case 0xF000: {
-            switch (kk) {
-                case 0x07: {
-                    // Fx07: LD Vx, DT (Set Vx = delay timer value)
-                    v[x] = delay_timer;
-                    break;
-                }
-                case 0x0A: {
-                    // Fx0A: LD Vx, K (Wait for a key press, store the value of
-                    // the key in Vx.)
-                    uint8_t i;
-                    for (i = 0x0; i <= 0xF; i++) {
-                        if (keypad[i]) {
-                            v[x] = i;
-                            break;
-                        }
-                    }
-                    // Repeat opcode if not found
-                    if (i == 0x10) {
-                        pc -= 2;
-                    }
-                    break;
-                }
-                case 0x15: {
-                    // Fx15: LD DT, Vx (Set delay timer = Vx)
-                    delay_timer = v[x];
-                    break;
-                }
-                case 0x18: {
-                    // Fx18: LD ST, Vx (Set sound timer = Vx)
-                    sound_timer = v[x];
-                    break;
-                }
-                case 0x1E: {
-                    // Fx1E: ADD I, Vx (Set I = I + Vx)
-                    index += v[x];
-                    break;
-                }
-                case 0x29: {
-                    // Fx29: LD F, Vx (Set I = location of sprite for digit Vx)
-                    index = 0x50 + v[x] * 5;
-                    break;
-                }
-                case 0x33: {
-                    // Fx33: LD B, Vx (Store BCD representation of Vx in memory
-                    // locations I, I+1, and I+2)
-                    memory[index] = (v[x] / 100) % 10;
-                    memory[index + 1] = (v[x] / 10) % 10;
-                    memory[index + 2] = (v[x] / 1) % 10;
-                    break;
-                }
-                case 0x55: {
-                    // Fx55: LD [I], Vx (Store registers V0 through Vx in memory
-                    // starting at location I)
-                    for (auto i = 0x0; i <= x; i++) {
-                        memory[index + i] = v[i];
-                    }
-                    // QUIRK: INCREMENT INDEX OR NOT
-                    // index += x + 1;
-                    break;
-                }
-                case 0x65: {
-                    // Fx65: LD Vx, [I] (Read registers V0 through Vx from
-                    // memory starting at location I.
-                    for (auto i = 0x0; i <= x; i++) {
-                        v[i] = memory[index + i];
-                    }
-                    // QUIRK: INCREMENT INDEX OR NOT
-                    // index += x + 1;
-                    break;
-                }
-                default: {
-                    std::stringstream ss;
-                    ss << "Unknown opcode [0xF000 family]: 0x" << std::hex
-                       << opcode;
-                    throw std::runtime_error(ss.str());
-                }
-            }
-            break;
-        }
-        default: {
-            std::stringstream ss;
-            ss << "Unknown or unimplemented opcode: 0x" << std::hex << opcode;
-            throw std::runtime_error(ss.str());
+void Chip8::InvalidateDecoded(const uint16_t address, const size_t length) {
+    // An instruction starting one byte earlier also overlaps the first byte,
+    // and a jump up to 4 bytes later may have been decoded as closing an
+    // idle loop over these bytes. Only the handler is cleared: a store may
+    // overwrite its own instruction while the handler still reads operands.
+    // Entries never decoded are left alone, so their page can stay shared.
+    for (size_t i = 0; i <= length + 4; i++) {
+        const uint16_t at = address - 1 + i;
+        if (decoded[at].handler) {
+            decoded.Mutable(at).handler = nullptr;
         }
     }
-}
\ No newline at end of file
+    if (block_engine) {
+        block_engine->Invalidate(address, length);
+    }
+    // Every memory write ends up here, so watchpoints cost nothing elsewhere
+    if (debugger) {
+        debugger->Written(*this, address, length);
+    }
+}
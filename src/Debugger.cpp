@@ -0,0 +1,267 @@
+#include "Debugger.h"
+#include "Chip8.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <string_view>
+#include <utility>
+
+namespace {
+// All of `text` as a hex number up to `max`
+bool ParseHex(const std::string_view text, uint16_t &value,
+              const unsigned max = 0xFFFF) {
+    unsigned parsed;
+    const auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), parsed, 16);
+    if (text.empty() || error != std::errc{} ||
+        end != text.data() + text.size() || parsed > max) {
+        return false;
+    }
+    value = static_cast<uint16_t>(parsed);
+    return true;
+}
+
+const char *StopName(const Debugger::Stop stop) {
+    switch (stop) {
+        case Debugger::Stop::Breakpoint:
+            return "breakpoint";
+        case Debugger::Stop::Watchpoint:
+            return "watchpoint";
+        case Debugger::Stop::Step:
+            return "step";
+        default:
+            return "stopped";
+    }
+}
+} // namespace
+
+bool Breakpoint::Holds(const Chip8 &chip) const {
+    const uint16_t actual = reg < 16 ? chip.v[reg] : chip.index;
+    switch (compare) {
+        case Compare::Equal:
+            return actual == value;
+        case Compare::NotEqual:
+            return actual != value;
+        case Compare::Less:
+            return actual < value;
+        case Compare::Greater:
+            return actual > value;
+        default:
+            return true;
+    }
+}
+
+bool ParseBreakpoint(const std::string &text, Breakpoint &breakpoint) {
+    const std::string_view all = text;
+    const auto colon = all.find(':');
+    Breakpoint parsed;
+    if (!ParseHex(all.substr(0, colon), parsed.address)) {
+        return false;
+    }
+    if (colon == std::string_view::npos) {
+        breakpoint = parsed;
+        return true;
+    }
+
+    // The register, then the comparison and the value
+    std::string_view condition = all.substr(colon + 1);
+    const auto first = [&] {
+        return std::tolower(static_cast<unsigned char>(condition[0]));
+    };
+    uint16_t reg;
+    if (condition.size() >= 2 && first() == 'v' &&
+        ParseHex(condition.substr(1, 1), reg, 0xF)) {
+        parsed.reg = static_cast<uint8_t>(reg);
+        condition.remove_prefix(2);
+    } else if (!condition.empty() && first() == 'i') {
+        parsed.reg = 16;
+        condition.remove_prefix(1);
+    } else {
+        return false;
+    }
+    constexpr std::pair<std::string_view, Breakpoint::Compare> kCompares[] = {
+        {"==", Breakpoint::Compare::Equal},
+        {"!=", Breakpoint::Compare::NotEqual},
+        {"<", Breakpoint::Compare::Less},
+        {">", Breakpoint::Compare::Greater},
+    };
+    for (const auto &[name, compare] : kCompares) {
+        if (condition.starts_with(name)) {
+            parsed.compare = compare;
+            condition.remove_prefix(name.size());
+            if (!ParseHex(condition, parsed.value,
+                          parsed.reg < 16 ? 0xFF : 0xFFFF)) {
+                return false;
+            }
+            breakpoint = parsed;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParseWatchpoint(const std::string &text, Watchpoint &watchpoint) {
+    const std::string_view all = text;
+    const auto dash = all.find('-');
+    Watchpoint parsed;
+    if (!ParseHex(all.substr(0, dash), parsed.first)) {
+        return false;
+    }
+    parsed.last = parsed.first;
+    if (dash != std::string_view::npos &&
+        (!ParseHex(all.substr(dash + 1), parsed.last) ||
+         parsed.last < parsed.first)) {
+        return false;
+    }
+    watchpoint = parsed;
+    return true;
+}
+
+Debugger::Debugger(const size_t trace_size) : trace(trace_size) {}
+
+void Debugger::Add(const Breakpoint &breakpoint) {
+    breakpoints.push_back(breakpoint);
+    armed.set(breakpoint.address);
+}
+
+void Debugger::Add(const Watchpoint &watchpoint) {
+    watchpoints.push_back(watchpoint);
+}
+
+void Debugger::Clear() {
+    breakpoints.clear();
+    watchpoints.clear();
+    armed.reset();
+}
+
+void Debugger::Continue() {
+    stopped = false;
+    resuming = true;
+}
+
+void Debugger::Step(const uint64_t count) {
+    steps = count;
+    Continue();
+}
+
+void Debugger::Run(Chip8 &chip) {
+    if (stopped) {
+        chip.idle = Idle::Break;
+        return;
+    }
+
+    const auto halt = [&](const Stop why, const uint16_t pc) {
+        stop = why;
+        stop_pc = pc;
+        stopped = true;
+        steps = 0;
+        chip.idle = Idle::Break;
+    };
+    const uint64_t end = chip.cycles + chip.budget;
+    running = true;
+    while (chip.budget) {
+        const uint16_t pc = chip.memory.Wrap(chip.pc);
+        if (armed[pc] && !resuming) {
+            for (const auto &breakpoint : breakpoints) {
+                if (breakpoint.address == pc && breakpoint.Holds(chip)) {
+                    halt(Stop::Breakpoint, pc);
+                    break;
+                }
+            }
+            if (stopped) {
+                break;
+            }
+        }
+        resuming = false;
+
+        if (!trace.empty()) {
+            trace[traced++ % trace.size()] = {
+                end - chip.budget, pc,
+                static_cast<uint16_t>(chip.memory[pc] << 8 |
+                                      chip.memory[pc + 1])};
+        }
+        hit = false;
+        chip.budget--;
+        chip.HandleOpcode();
+
+        if (hit) {
+            halt(Stop::Watchpoint, pc);
+            break;
+        }
+        if (steps && --steps == 0) {
+            halt(Stop::Step, chip.memory.Wrap(chip.pc));
+            break;
+        }
+    }
+    running = false;
+}
+
+void Debugger::Written(const Chip8 &chip, const uint16_t address,
+                       const size_t length) {
+    if (!running) {
+        return;
+    }
+    for (size_t i = 0; i < length && !hit; i++) {
+        const uint16_t at = chip.memory.Wrap(address + i);
+        for (const auto &watchpoint : watchpoints) {
+            if (at >= watchpoint.first && at <= watchpoint.last) {
+                written = at;
+                hit = true;
+                break;
+            }
+        }
+    }
+}
+
+std::string Debugger::Status(const Chip8 &chip) const {
+    char line[128];
+    auto length =
+        stopped ? std::snprintf(line, sizeof(line), "%s at %03x",
+                                StopName(stop), stop_pc)
+                : std::snprintf(line, sizeof(line), "running");
+    if (stopped && stop == Stop::Watchpoint) {
+        length += std::snprintf(line + length, sizeof(line) - length,
+                                " wrote %03x", written);
+    }
+    length += std::snprintf(line + length, sizeof(line) - length,
+                            "  pc %03x  I %03x  V", chip.pc, chip.index);
+    for (auto r = 0; r < 16; r++) {
+        length += std::snprintf(line + length, sizeof(line) - length,
+                                r % 8 ? "%02x" : " %02x", chip.v[r]);
+    }
+    return line;
+}
+
+std::string Debugger::Report(const Chip8 &chip) const {
+    std::string out = "Debugger: " + Status(chip) + "\n";
+    char line[64];
+    // Only a stop brings the clock up to date mid-batch
+    if (stopped) {
+        std::snprintf(line, sizeof(line), "  cycle %llu",
+                      static_cast<unsigned long long>(chip.cycles));
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "  sp %u  stack", chip.sp);
+    out += line;
+    for (auto i = 0; i < chip.sp && i < 16; i++) {
+        std::snprintf(line, sizeof(line), " %03x", chip.stack[i]);
+        out += line;
+    }
+    out += "\n";
+
+    const size_t count = std::min(traced, trace.size());
+    if (count) {
+        out += "Last " + std::to_string(count) +
+               " instructions, oldest first:\n";
+    }
+    for (size_t i = traced - count; i < traced; i++) {
+        const Executed &executed = trace[i % trace.size()];
+        std::snprintf(line, sizeof(line), "  %10llu  %03x  %04x\n",
+                      static_cast<unsigned long long>(executed.cycle),
+                      executed.pc, executed.opcode);
+        out += line;
+    }
+    return out;
+}
@@ -0,0 +1,46 @@
+#include "FrameScheduler.h"
+
+#include <thread>
+
+namespace {
+constexpr auto kFramePeriod = std::chrono::nanoseconds(
+    1000000000 / FrameScheduler::kFrameRate); // 60 Hz Frames
+
+// Frames we may fall behind before giving up on catching up
+constexpr int kMaxLag = 5;
+} // namespace
+
+FrameScheduler::FrameScheduler(const double cycles_per_second,
+                               const bool turbo, const int frame_skip)
+    : cycles_per_second(cycles_per_second), turbo(turbo),
+      frame_skip(frame_skip), deadline(Clock::now() + kFramePeriod) {}
+
+// Counted in 60ths of a cycle, which is exact for a whole clock speed: frame
+// n always ends on cycle hz * n / 60, so runs agree frame for frame
+uint64_t FrameScheduler::NextBatch() {
+    carry += cycles_per_second;
+    const auto cycles = static_cast<uint64_t>(carry / kFrameRate);
+    carry -= static_cast<double>(cycles) * kFrameRate;
+    return cycles;
+}
+
+bool FrameScheduler::ShouldPresent() const {
+    return !turbo || frame % (frame_skip + 1) == 0;
+}
+
+void FrameScheduler::EndFrame(const bool idle) {
+    frame++;
+    if (turbo && !idle) {
+        return;
+    }
+
+    std::this_thread::sleep_until(deadline);
+    deadline += kFramePeriod;
+
+    // After a long stall (suspend, slow terminal) start pacing afresh
+    // instead of running a burst of frames to catch up
+    if (const auto now = Clock::now();
+        now - deadline > kMaxLag * kFramePeriod) {
+        deadline = now + kFramePeriod;
+    }
+}
@@ -0,0 +1,321 @@
+#include "FrameSink.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+constexpr char kMagic[4] = {'C', '8', 'F', 'S'};
+constexpr uint8_t kVersion = 1;
+constexpr uint8_t kKeyframe = 1;
+constexpr uint8_t kHires = 2;
+
+void PutFixed(std::string &out, uint64_t value, const int bytes) {
+    for (auto i = 0; i < bytes; i++, value >>= 8) {
+        out.push_back(static_cast<char>(value & 0xFF));
+    }
+}
+
+void PutVarint(std::string &out, uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    }
+    out.push_back(static_cast<char>(value));
+}
+} // namespace
+
+uint64_t HashFrame(const Display &gfx) {
+    uint64_t hash = 0xCBF29CE484222325;
+    for (auto p = 0; p < gfx.Planes(); p++) {
+        const uint64_t *const plane = gfx.Plane(p);
+        if (p > 0 && std::all_of(plane, plane + gfx.Words(),
+                                 [](const uint64_t word) { return !word; })) {
+            continue;
+        }
+        for (auto word = 0; word < gfx.Words(); word++) {
+            for (auto byte = 0; byte < 8; byte++) {
+                hash = (hash ^ (plane[word] >> 8 * byte & 0xFF)) *
+                       0x100000001B3;
+            }
+        }
+    }
+    return hash;
+}
+
+BackgroundWriter::~BackgroundWriter() { Close(); }
+
+bool BackgroundWriter::Open(const char *filename) {
+    Close();
+    file.open(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    this->filename = filename;
+    pending = closing = failed = false;
+    thread = std::thread(&BackgroundWriter::Run, this);
+    return true;
+}
+
+void BackgroundWriter::Write(const void *data, const size_t size) {
+    filling.append(static_cast<const char *>(data), size);
+    if (filling.size() >= kBufferSize) {
+        Hand();
+    }
+}
+
+bool BackgroundWriter::Close() {
+    if (!thread.joinable()) {
+        return true;
+    }
+    if (!filling.empty()) {
+        Hand();
+    }
+    {
+        const std::lock_guard lock(mutex);
+        closing = true;
+    }
+    changed.notify_all();
+    thread.join();
+
+    file.close();
+    if (failed || file.fail()) {
+        std::cerr << "Error: Could not write file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Waits for the thread to finish the buffer before, if it hasn't yet
+void BackgroundWriter::Hand() {
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [&] { return !pending; });
+    filling.swap(writing);
+    pending = true;
+    changed.notify_all();
+}
+
+void BackgroundWriter::Run() {
+    std::unique_lock lock(mutex);
+    for (;;) {
+        changed.wait(lock, [&] { return pending || closing; });
+        if (!pending) {
+            return; // Closing, and everything is written
+        }
+        lock.unlock();
+        file.write(writing.data(),
+                   static_cast<std::streamsize>(writing.size()));
+        const bool written = file.good();
+        writing.clear();
+        lock.lock();
+        failed |= !written;
+        pending = false;
+        changed.notify_all();
+    }
+}
+
+FrameStreamWriter::FrameStreamWriter(const int keyframe_interval)
+    : keyframe_interval(std::max(keyframe_interval, 1)) {}
+
+bool FrameStreamWriter::Open(const char *filename) {
+    if (!out.Open(filename)) {
+        return false;
+    }
+    std::string header(kMagic, sizeof(kMagic));
+    PutFixed(header, kVersion, 1);
+    PutFixed(header, 0, 3);
+    out.Write(header.data(), header.size());
+    frames = 0;
+    return true;
+}
+
+void FrameStreamWriter::Present(const Display &gfx) {
+    const bool keyframe =
+        frames % keyframe_interval == 0 || gfx.hires != last.hires;
+    if (keyframe && last.Extended() != gfx.Extended()) {
+        last = Display(gfx.Extended());
+    } else if (keyframe) {
+        last.Clear();
+    }
+
+    // Both planes as one run of words
+    const int words = gfx.Words();
+    const int total = Display::kPlanes * words;
+    uint64_t diff[Display::kPlanes * Display::kWords];
+    for (auto p = 0; p < Display::kPlanes; p++) {
+        for (auto word = 0; word < words; word++) {
+            diff[p * words + word] =
+                gfx.Word(p, word) ^ last.Word(p, word);
+        }
+    }
+
+    record.clear();
+    PutFixed(record, (keyframe ? kKeyframe : 0) | (gfx.hires ? kHires : 0),
+             1);
+    for (auto i = 0; i < total;) {
+        auto start = i;
+        while (i < total && !diff[i]) {
+            i++;
+        }
+        PutVarint(record, i - start);
+        start = i;
+        while (i < total && diff[i]) {
+            i++;
+        }
+        PutVarint(record, i - start);
+        for (auto word = start; word < i; word++) {
+            PutFixed(record, diff[word], 8);
+        }
+    }
+    out.Write(record.data(), record.size());
+
+    last = gfx;
+    frames++;
+}
+
+bool FrameStreamWriter::Close() { return out.Close(); }
+
+bool FrameStreamReader::Open(const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), {});
+    at = 0;
+    last = Display(true); // A stream doesn't say which machine wrote it
+
+    try {
+        for (const char c : kMagic) {
+            if (Byte() != static_cast<uint8_t>(c)) {
+                throw std::runtime_error("not a frame stream");
+            }
+        }
+        if (Byte() != kVersion) {
+            throw std::runtime_error("unsupported version");
+        }
+        for (auto i = 0; i < 3; i++) {
+            Byte(); // Reserved
+        }
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Error: " << filename << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FrameStreamReader::Next(Display &gfx) {
+    if (at == data.size()) {
+        return false;
+    }
+    const uint8_t tag = Byte();
+    const bool hires = tag & kHires;
+    if (tag & kKeyframe) {
+        last.Clear();
+        last.hires = hires;
+    } else if (hires != last.hires) {
+        throw std::runtime_error("resolution changed without a keyframe");
+    }
+
+    const int words = last.Words();
+    const int total = Display::kPlanes * words;
+    for (auto i = 0; i < total;) {
+        const uint64_t unchanged = Varint();
+        const uint64_t changed = Varint();
+        const auto left = static_cast<uint64_t>(total - i);
+        if (unchanged + changed == 0 || unchanged > left ||
+            changed > left - unchanged) {
+            throw std::runtime_error("bad run");
+        }
+        i += static_cast<int>(unchanged);
+        for (const int end = i + static_cast<int>(changed); i < end; i++) {
+            uint64_t word = 0;
+            for (auto byte = 0; byte < 8; byte++) {
+                word |= uint64_t{Byte()} << 8 * byte;
+            }
+            last.Plane(i / words)[i % words] ^= word;
+        }
+    }
+    gfx = last;
+    return true;
+}
+
+uint8_t FrameStreamReader::Byte() {
+    if (at >= data.size()) {
+        throw std::runtime_error("truncated");
+    }
+    return static_cast<uint8_t>(data[at++]);
+}
+
+uint64_t FrameStreamReader::Varint() {
+    uint64_t value = 0;
+    for (auto shift = 0; shift < 64; shift += 7) {
+        const uint8_t byte = Byte();
+        value |= uint64_t{byte & 0x7Fu} << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("bad varint");
+}
+
+bool FrameHashWriter::Open(const char *filename) {
+    return out.Open(filename);
+}
+
+void FrameHashWriter::Present(const Display &gfx) {
+    char line[20];
+    const int length =
+        std::snprintf(line, sizeof(line), "%016llx\n",
+                      static_cast<unsigned long long>(HashFrame(gfx)));
+    out.Write(line, length);
+}
+
+bool FrameHashWriter::Close() { return out.Close(); }
+
+bool LoadFrameHashes(const char *filename, std::vector<uint64_t> &hashes) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    hashes.clear();
+
+    char magic[sizeof(kMagic)]{};
+    if (file.read(magic, sizeof(magic)) &&
+        std::equal(magic, magic + sizeof(magic), kMagic)) {
+        FrameStreamReader stream;
+        if (!stream.Open(filename)) {
+            return false;
+        }
+        try {
+            for (Display gfx; stream.Next(gfx);) {
+                hashes.push_back(HashFrame(gfx));
+            }
+        } catch (const std::runtime_error &e) {
+            std::cerr << "Error: " << filename << ": " << e.what()
+                      << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    file.clear();
+    file.seekg(0);
+    std::string line;
+    for (auto number = 1; std::getline(file, line); number++) {
+        uint64_t hash;
+        const auto [end, error] =
+            std::from_chars(line.data(), line.data() + line.size(), hash, 16);
+        if (error != std::errc{} || end != line.data() + line.size()) {
+            std::cerr << filename << ":" << number
+                      << ": Not a frame hash: " << line << std::endl;
+            return false;
+        }
+        hashes.push_back(hash);
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#include "KeyRepeat.h"
+
+KeyRepeat::KeyRepeat(const Clock::duration delay,
+                     const Clock::duration interval)
+    : delay(delay), interval(interval) {}
+
+bool KeyRepeat::Press(const uint8_t key, const Clock::time_point now) {
+    const uint16_t bit = 1 << (key & 0xF);
+    const bool first = !(held & bit);
+    held |= bit;
+    repeating = first ? repeating & ~bit : repeating | bit;
+    last[key & 0xF] = now;
+    return first;
+}
+
+uint16_t KeyRepeat::Release(const Clock::time_point now) {
+    uint16_t released = 0;
+    for (auto key = 0; key < 16; key++) {
+        const uint16_t bit = 1 << key;
+        if (held & bit &&
+            now - last[key] > (repeating & bit ? interval : delay)) {
+            released |= bit;
+        }
+    }
+    held &= ~released;
+    return released;
+}
@@ -0,0 +1,509 @@
+#include "Lockstep.h"
+#include "Chip8.h"
+#include "Opcodes.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <memory>
+
+LockstepEngine::LockstepEngine(const size_t lanes, const Profile profile)
+    : lanes(lanes), profile(profile), v(16 * lanes), index(lanes), pc(lanes),
+      stack(16 * lanes), sp(lanes), keypad(lanes), cycles(lanes),
+      delay_expiry(lanes), sound_expiry(lanes), rng(lanes),
+      remaining(lanes), faulted(lanes), active(lanes), mask(lanes),
+      memory(4096 * lanes), gfx(32 * lanes) {
+    // Every lane starts as a freshly reset machine
+    const auto blank = std::make_unique<Chip8>(profile);
+    for (size_t lane = 0; lane < lanes; lane++) {
+        Load(lane, *blank);
+        Seed(lane, lane);
+    }
+}
+
+void LockstepEngine::Load(const size_t lane, const Chip8 &chip) {
+    for (auto x = 0; x < 16; x++) {
+        V(x)[lane] = chip.v[x];
+        stack[x * lanes + lane] = chip.stack[x];
+    }
+    keypad[lane] = chip.keypad;
+    index[lane] = chip.index;
+    pc[lane] = chip.pc;
+    sp[lane] = chip.sp;
+    cycles[lane] = chip.cycles;
+    delay_expiry[lane] = chip.delay_expiry;
+    sound_expiry[lane] = chip.sound_expiry;
+    rng[lane] = chip.rng;
+    // Lanes are 4K, 64x32 machines: anything larger is faulted from the start
+    faulted[lane] = chip.memory.Size() != 4096 || chip.gfx.hires;
+    chip.memory.Read(0, Memory(lane), 4096);
+    std::copy_n(chip.gfx.Plane(0), 32, &gfx[lane * 32]);
+    recheck = true;
+}
+
+void LockstepEngine::Store(const size_t lane, Chip8 &chip) const {
+    for (auto x = 0; x < 16; x++) {
+        chip.v[x] = v[x * lanes + lane];
+        chip.stack[x] = stack[x * lanes + lane];
+    }
+    chip.keypad = keypad[lane];
+    chip.index = index[lane];
+    chip.pc = pc[lane];
+    chip.sp = sp[lane];
+    chip.clock_hz = clock_hz;
+    chip.cycles = cycles[lane];
+    chip.tick = Tick(lane);
+    chip.delay_expiry = delay_expiry[lane];
+    chip.sound_expiry = sound_expiry[lane];
+    chip.sound_playing = chip.SoundTimer() > 0;
+    chip.rng = rng[lane];
+    chip.idle = Idle::None;
+    chip.memory.Write(0, &memory[lane * 4096], 4096);
+    chip.gfx.Clear();
+    std::copy_n(&gfx[lane * 32], 32, chip.gfx.Plane(0));
+    chip.draw_flag = true;
+    chip.InvalidateDecoded(0, 4096);
+}
+
+void LockstepEngine::Seed(const size_t lane, const uint64_t seed) {
+    rng[lane] = SeedRandom(seed);
+}
+
+void LockstepEngine::Run(const uint64_t cycles) {
+    WithQuirks(profile, [&]<typename Quirks>(Quirks) { Run<Quirks>(cycles); });
+}
+
+template <typename Quirks> void LockstepEngine::Run(const uint64_t count) {
+    if (recheck) {
+        uniform = true;
+        for (size_t lane = 1; lane < lanes && uniform; lane++) {
+            uniform = std::memcmp(Memory(lane), Memory(0), 4096) == 0;
+        }
+        if (uniform) {
+            written.reset();
+        }
+        recheck = false;
+    }
+
+    // Locals, so that the compiler needn't assume the byte arrays alias them
+    const size_t width = lanes;
+    uint8_t *const active = this->active.data();
+    uint8_t *const m = mask.data();
+    const uint16_t *const pcs = pc.data();
+    uint64_t *const left = remaining.data();
+
+    // `cycles` moves to the end of the Run up front; a lane is at cycle
+    // cycles - remaining as it goes. Also find the lowest PC of any lane
+    // with cycles left, the next step's.
+    uint32_t low = 0x10000;
+    for (size_t lane = 0; lane < width; lane++) {
+        left[lane] = faulted[lane] ? 0 : count;
+        cycles[lane] += left[lane];
+        active[lane] = left[lane] != 0;
+        low = std::min<uint32_t>(low, active[lane] ? pcs[lane] : 0x10000);
+    }
+
+    while (low != 0x10000) {
+        // The group: the lanes at the lowest PC with the leader's opcode
+        const uint16_t at = low & 0xFFF;
+        const auto fetch = [&](const size_t lane) {
+            const uint8_t *bytes = Memory(lane);
+            return static_cast<uint16_t>(bytes[at] << 8 |
+                                         bytes[(at + 1) & 0xFFF]);
+        };
+        size_t leader = 0;
+        while (!active[leader] || pcs[leader] != low) {
+            leader++;
+        }
+        const uint16_t opcode = fetch(leader);
+        for (size_t lane = 0; lane < width; lane++) {
+            m[lane] = active[lane] & (pcs[lane] == low);
+        }
+        if (!uniform || written[at] || written[(at + 1) & 0xFFF]) {
+            for (size_t lane = leader; lane < width; lane++) {
+                m[lane] = m[lane] && fetch(lane) == opcode;
+            }
+        }
+
+        Execute<Quirks>(opcode, low);
+
+        uint32_t stepped = 0;
+        low = 0x10000;
+        for (size_t lane = 0; lane < width; lane++) {
+            left[lane] -= m[lane];
+            active[lane] = left[lane] != 0;
+            stepped += m[lane];
+            low = std::min<uint32_t>(low, active[lane] ? pcs[lane] : 0x10000);
+        }
+        steps++;
+        lane_steps += stepped;
+    }
+}
+
+// Run `opcode`, found at `address`, in every lane of the mask. Each case
+// mirrors its handler in Opcodes.h. The step's cycle is counted after it
+// runs, so Tick() is the tick the instruction runs in.
+template <typename Quirks>
+void LockstepEngine::Execute(const uint16_t opcode, const uint16_t address) {
+    const uint16_t nnn = opcode & 0x0FFF;
+    const uint8_t kk = opcode & 0x00FF;
+    const uint8_t x = (opcode & 0x0F00) >> 8;
+    const uint8_t y = (opcode & 0x00F0) >> 4;
+    const uint8_t n = opcode & 0x000F;
+    const uint16_t next = address + 2;
+
+    uint8_t *const vx = V(x);
+    uint8_t *const vy = V(y);
+    uint8_t *const vf = V(0xF);
+    const uint8_t *const m = mask.data();
+    const size_t width = lanes;
+
+    // `dst` = f(lane) in every lane of the mask. Written as a select rather
+    // than a branch so that the loop vectorizes.
+    const auto set = [&](auto *dst, auto f) {
+        for (size_t lane = 0; lane < width; lane++) {
+            dst[lane] = m[lane] ? f(lane) : dst[lane];
+        }
+    };
+    // Skip the next instruction in the lanes where cond(lane) holds
+    const auto skip = [&](auto cond) {
+        set(pc.data(), [&](const size_t lane) {
+            return static_cast<uint16_t>(next + (cond(lane) ? 2 : 0));
+        });
+    };
+    // Per-lane work that does not vectorize (memory, the stack, ...)
+    const auto each = [&](auto f) {
+        for (size_t lane = 0; lane < width; lane++) {
+            if (m[lane]) {
+                f(lane);
+            }
+        }
+    };
+    // Nothing changes for the rest of the Run: spend it in one step
+    const auto idle = [&](const size_t lane) { remaining[lane] = 1; };
+    // Polling the delay timer: skip the whole iterations left before the
+    // next tick, as Op1nnnDelayPoll does
+    const auto poll = [&](const size_t lane) {
+        const uint64_t tick = Tick(lane);
+        const uint8_t polled = V(Memory(lane)[nnn] & 0xF)[lane];
+        if (polled != (delay_expiry[lane] > tick ? delay_expiry[lane] - tick
+                                                 : 0)) {
+            return;
+        }
+        const uint64_t tick_end = ((tick + 1) * clock_hz + 59) / 60;
+        const uint64_t left = std::min(cycles[lane], tick_end) -
+                              (cycles[lane] - remaining[lane] + 1);
+        remaining[lane] -= left - left % 3;
+    };
+
+    set(pc.data(), [&](size_t) { return next; });
+
+    // SUPER-CHIP and XO-CHIP instructions are the interpreter's alone
+    if constexpr (Quirks::extensions != Extensions::None) {
+        if (ExtensionHandler<Quirks>(opcode)) {
+            each([&](const size_t lane) { Fault(lane); });
+            return;
+        }
+    }
+
+    switch (opcode & 0xF000) {
+        case 0x0000: {
+            switch (kk) {
+                case 0xE0:
+                    each([&](const size_t lane) {
+                        std::fill_n(&gfx[lane * 32], 32, 0);
+                    });
+                    break;
+                case 0xEE:
+                    each([&](const size_t lane) {
+                        sp[lane]--;
+                        pc[lane] = stack[(sp[lane] & 0xF) * lanes + lane];
+                    });
+                    break;
+                default:
+                    break;
+            }
+            break;
+        }
+        case 0x1000:
+            set(pc.data(), [&](size_t) { return nnn; });
+            if (nnn == address) {
+                each(idle);
+            } else if (nnn + 4 == address) {
+                each([&](const size_t lane) {
+                    if (IsDelayPoll(Memory(lane), nnn)) {
+                        poll(lane);
+                    }
+                });
+            }
+            break;
+        case 0x2000:
+            each([&](const size_t lane) {
+                stack[(sp[lane] & 0xF) * lanes + lane] = next;
+                sp[lane]++;
+                pc[lane] = nnn;
+            });
+            break;
+        case 0x3000:
+            skip([&](const size_t lane) { return vx[lane] == kk; });
+            break;
+        case 0x4000:
+            skip([&](const size_t lane) { return vx[lane] != kk; });
+            break;
+        case 0x5000:
+            skip([&](const size_t lane) { return vx[lane] == vy[lane]; });
+            break;
+        case 0x6000:
+            set(vx, [&](size_t) { return kk; });
+            break;
+        case 0x7000:
+            set(vx, [&](const size_t lane) {
+                return static_cast<uint8_t>(vx[lane] + kk);
+            });
+            break;
+        case 0x8000: {
+            // Results are computed before VF is written, in case x or y is F
+            const auto arithmetic = [&](auto result, auto flag) {
+                for (size_t lane = 0; lane < width; lane++) {
+                    const uint8_t r = result(lane), f = flag(lane);
+                    vx[lane] = m[lane] ? r : vx[lane];
+                    vf[lane] = m[lane] ? f : vf[lane];
+                }
+            };
+            const auto logic = [&](auto result) {
+                set(vx, result);
+                if constexpr (Quirks::logic_resets_vf) {
+                    set(vf, [](size_t) { return uint8_t{0}; });
+                }
+            };
+            const uint8_t *const shifted = Quirks::shift_uses_vy ? vy : vx;
+            switch (n) {
+                case 0x0:
+                    set(vx, [&](const size_t lane) { return vy[lane]; });
+                    break;
+                case 0x1:
+                    logic([&](const size_t lane) {
+                        return static_cast<uint8_t>(vx[lane] | vy[lane]);
+                    });
+                    break;
+                case 0x2:
+                    logic([&](const size_t lane) {
+                        return static_cast<uint8_t>(vx[lane] & vy[lane]);
+                    });
+                    break;
+                case 0x3:
+                    logic([&](const size_t lane) {
+                        return static_cast<uint8_t>(vx[lane] ^ vy[lane]);
+                    });
+                    break;
+                case 0x4:
+                    arithmetic(
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(vx[lane] + vy[lane]);
+                        },
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(vx[lane] + vy[lane] >
+                                                        0xFF);
+                        });
+                    break;
+                case 0x5:
+                    arithmetic(
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(vx[lane] - vy[lane]);
+                        },
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(vx[lane] >= vy[lane]);
+                        });
+                    break;
+                case 0x6:
+                    arithmetic(
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(shifted[lane] >> 1);
+                        },
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(shifted[lane] & 0x01);
+                        });
+                    break;
+                case 0x7:
+                    arithmetic(
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(vy[lane] - vx[lane]);
+                        },
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(vy[lane] >= vx[lane]);
+                        });
+                    break;
+                case 0xE:
+                    arithmetic(
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(shifted[lane] << 1);
+                        },
+                        [&](const size_t lane) {
+                            return static_cast<uint8_t>(shifted[lane] >> 7);
+                        });
+                    break;
+                default:
+                    each([&](const size_t lane) { Fault(lane); });
+                    break;
+            }
+            break;
+        }
+        case 0x9000:
+            skip([&](const size_t lane) { return vx[lane] != vy[lane]; });
+            break;
+        case 0xA000:
+            set(index.data(), [&](size_t) { return nnn; });
+            break;
+        case 0xB000: {
+            const uint8_t *const offset = V(Quirks::jump_uses_vx ? x : 0x0);
+            set(pc.data(), [&](const size_t lane) {
+                return static_cast<uint16_t>(nnn + offset[lane]);
+            });
+            break;
+        }
+        case 0xC000:
+            each([&](const size_t lane) {
+                vx[lane] = NextRandom(rng[lane]) & kk;
+            });
+            break;
+        case 0xD000:
+            each([&](const size_t lane) {
+                const auto startX = vx[lane] % 64;
+                const auto startY = vy[lane] % 32;
+                const uint8_t *const bytes = Memory(lane);
+                uint64_t *const rows = &gfx[lane * 32];
+
+                uint64_t collision = 0;
+                for (auto row = 0; row < n; row++) {
+                    if (Quirks::clip_sprites && startY + row >= 32) {
+                        break;
+                    }
+                    const uint64_t sprite =
+                        uint64_t{bytes[(index[lane] + row) & 0xFFF]} << 56;
+                    const uint64_t pixels = Quirks::clip_sprites
+                                                ? sprite >> startX
+                                                : std::rotr(sprite, startX);
+                    uint64_t &line = rows[(startY + row) % 32];
+                    collision |= line & pixels;
+                    line ^= pixels;
+                }
+                vf[lane] = collision != 0;
+            });
+            break;
+        case 0xE000: {
+            switch (kk) {
+                case 0x9E:
+                    skip([&](const size_t lane) {
+                        return keypad[lane] >> (vx[lane] & 0xF) & 1;
+                    });
+                    break;
+                case 0xA1:
+                    skip([&](const size_t lane) {
+                        return !(keypad[lane] >> (vx[lane] & 0xF) & 1);
+                    });
+                    break;
+                default:
+                    each([&](const size_t lane) { Fault(lane); });
+                    break;
+            }
+            break;
+        }
+        case 0xF000: {
+            switch (kk) {
+                case 0x07:
+                    each([&](const size_t lane) {
+                        const uint64_t tick = Tick(lane);
+                        vx[lane] = delay_expiry[lane] > tick
+                                       ? delay_expiry[lane] - tick
+                                       : 0;
+                    });
+                    break;
+                case 0x0A:
+                    // Keys only change between Runs: with none held, wait
+                    // out the rest of this one
+                    each([&](const size_t lane) {
+                        if (keypad[lane]) {
+                            vx[lane] = std::countr_zero(keypad[lane]);
+                        } else {
+                            pc[lane] = address;
+                            idle(lane);
+                        }
+                    });
+                    break;
+                case 0x15:
+                    each([&](const size_t lane) {
+                        delay_expiry[lane] = Tick(lane) + vx[lane];
+                    });
+                    break;
+                case 0x18:
+                    each([&](const size_t lane) {
+                        sound_expiry[lane] = Tick(lane) + vx[lane];
+                    });
+                    break;
+                case 0x1E:
+                    set(index.data(), [&](const size_t lane) {
+                        return static_cast<uint16_t>(index[lane] + vx[lane]);
+                    });
+                    break;
+                case 0x29:
+                    set(index.data(), [&](const size_t lane) {
+                        return static_cast<uint16_t>(0x50 + vx[lane] * 5);
+                    });
+                    break;
+                case 0x33:
+                    each([&](const size_t lane) {
+                        uint8_t *const bytes = Memory(lane);
+                        bytes[index[lane] & 0xFFF] = vx[lane] / 100 % 10;
+                        bytes[(index[lane] + 1) & 0xFFF] = vx[lane] / 10 % 10;
+                        bytes[(index[lane] + 2) & 0xFFF] = vx[lane] % 10;
+                        Written(index[lane], 3);
+                    });
+                    break;
+                case 0x55:
+                case 0x65:
+                    each([&](const size_t lane) {
+                        uint8_t *const bytes = Memory(lane);
+                        for (auto r = 0; r <= x; r++) {
+                            uint8_t &byte = bytes[(index[lane] + r) & 0xFFF];
+                            if (kk == 0x55) {
+                                byte = V(r)[lane];
+                            } else {
+                                V(r)[lane] = byte;
+                            }
+                        }
+                        if (kk == 0x55) {
+                            Written(index[lane], x + 1);
+                        }
+                        if constexpr (Quirks::load_store ==
+                                      IndexIncrement::X) {
+                            index[lane] += x;
+                        } else if constexpr (Quirks::load_store ==
+                                             IndexIncrement::XPlusOne) {
+                            index[lane] += x + 1;
+                        }
+                    });
+                    break;
+                default:
+                    each([&](const size_t lane) { Fault(lane); });
+                    break;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// An unknown opcode: the lane stops, its PC and clock just past it
+void LockstepEngine::Fault(const size_t lane) {
+    faulted[lane] = true;
+    cycles[lane] -= remaining[lane] - 1;
+    remaining[lane] = 1;
+}
+
+void LockstepEngine::Written(const uint16_t address, const int length) {
+    for (auto i = 0; i < length; i++) {
+        written.set((address + i) & 0xFFF);
+    }
+}
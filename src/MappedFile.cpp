@@ -0,0 +1,53 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data(std::exchange(other.data, nullptr)),
+      size(std::exchange(other.size, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        Close();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const char *filename) {
+    Close();
+    const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info {};
+    auto ok = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    // A zero-length mapping is an error, and an empty file needs none
+    if (ok && info.st_size > 0) {
+        void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE,
+                            fd, 0);
+        ok = mapped != MAP_FAILED;
+        if (ok) {
+            data = static_cast<const uint8_t *>(mapped);
+            size = info.st_size;
+        }
+    }
+    // The mapping holds its own reference to the file
+    close(fd);
+    return ok;
+}
+
+void MappedFile::Close() {
+    if (data) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+}
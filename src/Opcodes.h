@@ -0,0 +1,850 @@
+#ifndef CHIP_8_OPCODES_H
+#define CHIP_8_OPCODES_H
+#include "Chip8.h"
+#include "Quirks.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+// Opcode handlers. Each one implements a single instruction using the operands
+// predecoded into an Instruction; pc has already been advanced past it.
+// Handlers whose behaviour differs between platforms take the quirk profile
+// (Quirks.h) as a template argument.
+
+inline void Op0nnn(Chip8 &, const Instruction &) {
+    // 0nnn: SYS addr (Jump to a machine code routine at nnn)
+    // Modern interpreters ignores this opcode.
+}
+
+inline void Op00E0(Chip8 &c, const Instruction &) {
+    // 00E0: CLS (Clear the display). Only the selected planes (XO-CHIP).
+    for (auto p = 0; p < c.gfx.Planes(); p++) {
+        if (c.plane_mask >> p & 1) {
+            std::fill_n(c.gfx.Plane(p), c.gfx.Words(), 0);
+        }
+    }
+    c.draw_flag = true;
+}
+
+inline void Op00EE(Chip8 &c, const Instruction &) {
+    // 00EE: RET (Return from a subroutine)
+    c.pc = c.stack[--c.sp];
+}
+
+inline void Op1nnn(Chip8 &c, const Instruction &i) {
+    // 1nnn: JP addr (Jump to location nnn)
+    c.pc = i.nnn;
+}
+
+inline void Op2nnn(Chip8 &c, const Instruction &i) {
+    // 2nnn: CALL addr (Call subroutine at nnn)
+    c.stack[c.sp++] = c.pc;
+    c.pc = i.nnn;
+}
+
+// Skip the next instruction, which under XO-CHIP may be the 4 byte F000 nnnn
+template <typename Quirks> inline void Skip(Chip8 &c) {
+    if constexpr (Quirks::extensions == Extensions::XoChip) {
+        if (c.memory[c.pc] == 0xF0 && c.memory[c.pc + 1] == 0x00) {
+            c.pc += 2;
+        }
+    }
+    c.pc += 2;
+}
+
+template <typename Quirks>
+inline void Op3xkk(Chip8 &c, const Instruction &i) {
+    // 3xkk: SE Vx, byte (Skip next instruction if Vx = kk)
+    if (c.v[i.x] == i.kk) {
+        Skip<Quirks>(c);
+    }
+}
+
+template <typename Quirks>
+inline void Op4xkk(Chip8 &c, const Instruction &i) {
+    // 4xkk: SNE Vx, byte (Skip next instruction if Vx != kk)
+    if (c.v[i.x] != i.kk) {
+        Skip<Quirks>(c);
+    }
+}
+
+template <typename Quirks>
+inline void Op5xy0(Chip8 &c, const Instruction &i) {
+    // 5xy0 - SE Vx, Vy (Skip next instruction if Vx = Vy)
+    if (c.v[i.x] == c.v[i.y]) {
+        Skip<Quirks>(c);
+    }
+}
+
+inline void Op6xkk(Chip8 &c, const Instruction &i) {
+    // 6xkk: LD Vx, byte (Set Vx = kk)
+    c.v[i.x] = i.kk;
+}
+
+inline void Op7xkk(Chip8 &c, const Instruction &i) {
+    // 7xkk: ADD Vx, byte (Set Vx = Vx + kk)
+    c.v[i.x] += i.kk;
+}
+
+inline void Op8xy0(Chip8 &c, const Instruction &i) {
+    // 8xy0: LD Vx, Vy (Set Vx = Vy)
+    c.v[i.x] = c.v[i.y];
+}
+
+template <typename Quirks>
+inline void Op8xy1(Chip8 &c, const Instruction &i) {
+    // 8xy1: OR Vx, Vy (Set Vx = Vx OR Vy)
+    c.v[i.x] |= c.v[i.y];
+    if constexpr (Quirks::logic_resets_vf) {
+        c.v[0xF] = 0;
+    }
+}
+
+template <typename Quirks>
+inline void Op8xy2(Chip8 &c, const Instruction &i) {
+    // 8xy2: AND Vx, Vy (Set Vx = Vx AND Vy)
+    c.v[i.x] &= c.v[i.y];
+    if constexpr (Quirks::logic_resets_vf) {
+        c.v[0xF] = 0;
+    }
+}
+
+template <typename Quirks>
+inline void Op8xy3(Chip8 &c, const Instruction &i) {
+    // 8xy3: XOR Vx, Vy (Set Vx = Vx XOR Vy)
+    c.v[i.x] ^= c.v[i.y];
+    if constexpr (Quirks::logic_resets_vf) {
+        c.v[0xF] = 0;
+    }
+}
+
+inline void Op8xy4(Chip8 &c, const Instruction &i) {
+    // 8xy4: ADD Vx, Vy (Set Vx = Vx + Vy, set VF = carry)
+    uint8_t val_x = c.v[i.x], val_y = c.v[i.y];
+    uint16_t sum = val_x + val_y;
+    c.v[i.x] = sum & 0xFF;
+    c.v[0xF] = sum > 0xFF;
+}
+
+inline void Op8xy5(Chip8 &c, const Instruction &i) {
+    // 8xy5: SUB Vx, Vy (Set Vx = Vx - Vy, set VF = NOT borrow)
+    uint8_t val_y = c.v[i.y], val_x = c.v[i.x];
+    c.v[i.x] = val_x - val_y;
+    c.v[0xF] = val_x >= val_y;
+}
+
+template <typename Quirks>
+inline void Op8xy6(Chip8 &c, const Instruction &i) {
+    // 8xy6: SHR Vx {, Vy} (Set Vx = Vx SHR 1, set VF to the
+    // least significant bit of Vx before shift
+    // QUIRK: vX = vY >> 1 or vX = vX >> 1
+    uint8_t val = Quirks::shift_uses_vy ? c.v[i.y] : c.v[i.x];
+    c.v[i.x] = val >> 1;
+    c.v[0xF] = val & 0x01;
+}
+
+inline void Op8xy7(Chip8 &c, const Instruction &i) {
+    // 8xy7: SUBN Vx, Vy (Set Vx = Vy - Vx, set VF = NOT borrow)
+    uint8_t val_y = c.v[i.y], val_x = c.v[i.x];
+    c.v[i.x] = val_y - val_x;
+    c.v[0xF] = val_y >= val_x;
+}
+
+template <typename Quirks>
+inline void Op8xyE(Chip8 &c, const Instruction &i) {
+    // 8xyE: SHL Vx {, Vy} (Set Vx = Vx SHL 1, set VF to the
+    // most significant bit of Vx before shift)
+    // QUIRK: vX = vY << 1 or vX = vX << 1
+    uint8_t val = Quirks::shift_uses_vy ? c.v[i.y] : c.v[i.x];
+    c.v[i.x] = (val << 1) & 0xFF;
+    c.v[0xF] = (val & 0x80) >> 7;
+}
+
+template <typename Quirks>
+inline void Op9xy0(Chip8 &c, const Instruction &i) {
+    // 9xy0: SNE Vx, Vy (Skip next instruction if Vx != Vy)
+    if (c.v[i.x] != c.v[i.y]) {
+        Skip<Quirks>(c);
+    }
+}
+
+inline void OpAnnn(Chip8 &c, const Instruction &i) {
+    // Annn: LD I, addr (Set I = nnn)
+    c.index = i.nnn;
+}
+
+template <typename Quirks>
+inline void OpBnnn(Chip8 &c, const Instruction &i) {
+    // Bnnn : JP V0, addr (Jump to location nnn + V0)
+    // QUIRK: Bxnn jumps to xnn + Vx instead
+    c.pc = i.nnn + c.v[Quirks::jump_uses_vx ? i.x : 0x0];
+}
+
+inline void OpCxkk(Chip8 &c, const Instruction &i) {
+    // Cxkk: RND Vx, byte (Set Vx = random byte AND kk)
+    c.v[i.x] = NextRandom(c.rng) & i.kk;
+}
+
+// Dxyn under SUPER-CHIP and XO-CHIP: either resolution, a 16x16 sprite
+// (2 bytes a row) for n = 0, and one sprite per selected plane, read one
+// after the other from I. A sprite row lands in at most two words.
+template <typename Quirks>
+inline void DrawSprite(Chip8 &c, const Instruction &i) {
+    Display &d = c.gfx;
+    const int height = d.Height();
+    const int stride = d.Stride();
+    const int startX = c.v[i.x] & (d.Width() - 1);
+    const int startY = c.v[i.y] & (height - 1);
+    const int word = startX / 64; // Word the sprite's left edge is in
+    const int shift = startX % 64;
+    const int rows = i.n ? i.n : 16;
+    const int width = i.n ? 1 : 2; // Bytes per row
+
+    uint16_t address = c.index;
+    uint64_t collision = 0;
+    for (auto p = 0; p < d.Planes(); p++) {
+        if (!(c.plane_mask >> p & 1)) {
+            continue;
+        }
+        for (auto row = 0; row < rows; row++, address += width) {
+            if (Quirks::clip_sprites && startY + row >= height) {
+                continue; // The next plane's sprite still starts after it
+            }
+            uint64_t sprite = c.memory[address];
+            if (width == 2) {
+                sprite = sprite << 8 | c.memory[address + 1];
+            }
+            sprite <<= 64 - 8 * width;
+
+            // The part in the first word, then the part past its right end:
+            // in the next word, or wrapped round to the row's first
+            uint64_t *const line =
+                d.Plane(p) + (startY + row) % height * stride;
+            const uint64_t left = sprite >> shift;
+            collision |= line[word] & left;
+            line[word] ^= left;
+            if (shift && (word + 1 < stride || !Quirks::clip_sprites)) {
+                uint64_t &next = line[(word + 1) % stride];
+                const uint64_t right = sprite << (64 - shift);
+                collision |= next & right;
+                next ^= right;
+            }
+        }
+    }
+
+    c.v[0xF] = collision != 0;
+    c.draw_flag = true;
+}
+
+template <typename Quirks>
+inline void OpDxyn(Chip8 &c, const Instruction &i) {
+    // Dxyn: DRW Vx, Vy, nibble (Display n-byte sprite starting at
+    // memory location I at (Vx, Vy), set VF = collision.)
+    if constexpr (Quirks::extensions != Extensions::None) {
+        DrawSprite<Quirks>(c, i);
+        return;
+    }
+
+    // The starting position always wraps
+    const auto startX = c.v[i.x] % 64;
+    const auto startY = c.v[i.y] % 32;
+
+    uint64_t *const plane = c.gfx.Plane(0);
+    uint64_t collision = 0;
+    for (auto row = 0; row < i.n; row++) {
+        // QUIRK: clip the sprite at the bottom edge instead of wrapping
+        if (Quirks::clip_sprites && startY + row >= 32) {
+            break;
+        }
+
+        // Sprite byte in the leftmost columns, then moved to startX. Pixels
+        // past the right edge are dropped (clip) or rotated round (wrap).
+        const uint64_t sprite = uint64_t{c.memory[c.index + row]} << 56;
+        const uint64_t pixels =
+            Quirks::clip_sprites ? sprite >> startX : std::rotr(sprite, startX);
+
+        // XOR: 0 ^ 0 = 0, 0 ^ 1 = 1, 1 ^ 0 = 1, 1 ^ 1 = 0
+        uint64_t &line = plane[(startY + row) % 32];
+        collision |= line & pixels;
+        line ^= pixels;
+    }
+
+    c.v[0xF] = collision != 0; // Collision! Set VF to 1
+
+    c.draw_flag = true;
+}
+
+template <typename Quirks>
+inline void OpEx9E(Chip8 &c, const Instruction &i) {
+    // Ex9E: SKP Vx (Skip next instruction if key with the value
+    // of Vx is pressed)
+    if (c.KeyDown(c.v[i.x])) {
+        Skip<Quirks>(c);
+    }
+}
+
+template <typename Quirks>
+inline void OpExA1(Chip8 &c, const Instruction &i) {
+    // ExA1: SKNP Vx (Skip next instruction if key with the
+    // value of Vx is not pressed)
+    if (!c.KeyDown(c.v[i.x])) {
+        Skip<Quirks>(c);
+    }
+}
+
+inline void OpFx07(Chip8 &c, const Instruction &i) {
+    // Fx07: LD Vx, DT (Set Vx = delay timer value)
+    c.v[i.x] = c.DelayTimer();
+}
+
+inline void OpFx0A(Chip8 &c, const Instruction &i) {
+    // Fx0A: LD Vx, K (Wait for a key press, store the value of
+    // the key in Vx.) The lowest key held down is taken.
+    if (c.keypad) {
+        c.v[i.x] = std::countr_zero(c.keypad);
+    } else {
+        // Repeat opcode if not found. Keys only change between RunCycles
+        // calls, so the rest of the batch would repeat it too: skip it.
+        c.pc -= 2;
+        c.budget = 0;
+        c.idle = Idle::Key;
+    }
+}
+
+inline void OpFx15(Chip8 &c, const Instruction &i) {
+    // Fx15: LD DT, Vx (Set delay timer = Vx)
+    c.SetDelayTimer(c.v[i.x]);
+}
+
+inline void OpFx18(Chip8 &c, const Instruction &i) {
+    // Fx18: LD ST, Vx (Set sound timer = Vx)
+    c.SetSoundTimer(c.v[i.x]);
+}
+
+inline void OpFx1E(Chip8 &c, const Instruction &i) {
+    // Fx1E: ADD I, Vx (Set I = I + Vx)
+    c.index += c.v[i.x];
+}
+
+inline void OpFx29(Chip8 &c, const Instruction &i) {
+    // Fx29: LD F, Vx (Set I = location of sprite for digit Vx)
+    c.index = 0x50 + c.v[i.x] * 5;
+}
+
+inline void OpFx33(Chip8 &c, const Instruction &i) {
+    // Fx33: LD B, Vx (Store BCD representation of Vx in memory
+    // locations I, I+1, and I+2)
+    c.memory.Write(c.index, (c.v[i.x] / 100) % 10);
+    c.memory.Write(c.index + 1, (c.v[i.x] / 10) % 10);
+    c.memory.Write(c.index + 2, (c.v[i.x] / 1) % 10);
+    c.InvalidateDecoded(c.index, 3);
+}
+
+// Fx55/Fx65: where I is left after transferring V0 through Vx
+template <typename Quirks>
+inline void AdvanceIndex(Chip8 &c, const Instruction &i) {
+    if constexpr (Quirks::load_store == IndexIncrement::X) {
+        c.index += i.x;
+    } else if constexpr (Quirks::load_store == IndexIncrement::XPlusOne) {
+        c.index += i.x + 1;
+    }
+}
+
+template <typename Quirks>
+inline void OpFx55(Chip8 &c, const Instruction &i) {
+    // Fx55: LD [I], Vx (Store registers V0 through Vx in memory
+    // starting at location I)
+    const uint16_t start = c.index;
+    for (auto r = 0x0; r <= i.x; r++) {
+        c.memory.Write(start + r, c.v[r]);
+    }
+    // QUIRK: INCREMENT INDEX OR NOT
+    AdvanceIndex<Quirks>(c, i);
+    // Last: invalidating may give this machine its own copy of the decoded
+    // page `i` lives in, and the shared one can go away with its other owner
+    c.InvalidateDecoded(start, i.x + 1);
+}
+
+template <typename Quirks>
+inline void OpFx65(Chip8 &c, const Instruction &i) {
+    // Fx65: LD Vx, [I] (Read registers V0 through Vx from
+    // memory starting at location I.
+    for (auto r = 0x0; r <= i.x; r++) {
+        c.v[r] = c.memory[c.index + r];
+    }
+    // QUIRK: INCREMENT INDEX OR NOT
+    AdvanceIndex<Quirks>(c, i);
+}
+
+// SUPER-CHIP and XO-CHIP. Clears, draws and scrolls act on the planes
+// selected by Fn01, which is plane 0 alone outside XO-CHIP.
+
+// Move the selected planes `rows` rows down, or up if negative
+inline void ScrollRows(Chip8 &c, const int rows) {
+    Display &d = c.gfx;
+    const int words = d.Words();
+    const int moved = std::min(std::abs(rows), d.Height()) * d.Stride();
+    for (auto p = 0; p < d.Planes(); p++) {
+        if (!(c.plane_mask >> p & 1)) {
+            continue;
+        }
+        uint64_t *const plane = d.Plane(p);
+        if (rows > 0) {
+            std::copy_backward(plane, plane + words - moved, plane + words);
+            std::fill_n(plane, moved, 0);
+        } else {
+            std::copy(plane + moved, plane + words, plane);
+            std::fill_n(plane + words - moved, moved, 0);
+        }
+    }
+    c.draw_flag = true;
+}
+
+// Move the selected planes 4 pixels right, or left
+inline void ScrollColumns(Chip8 &c, const bool right) {
+    Display &d = c.gfx;
+    for (auto p = 0; p < d.Planes(); p++) {
+        if (!(c.plane_mask >> p & 1)) {
+            continue;
+        }
+        uint64_t *const plane = d.Plane(p);
+        for (auto row = 0; row < d.Height(); row++) {
+            if (!d.hires) {
+                plane[row] = right ? plane[row] >> 4 : plane[row] << 4;
+                continue;
+            }
+            uint64_t &first = plane[2 * row];
+            uint64_t &second = plane[2 * row + 1];
+            if (right) {
+                second = second >> 4 | first << 60;
+                first >>= 4;
+            } else {
+                first = first << 4 | second >> 60;
+                second <<= 4;
+            }
+        }
+    }
+    c.draw_flag = true;
+}
+
+inline void Op00Cn(Chip8 &c, const Instruction &i) {
+    // 00Cn: SCD n (Scroll the display down n rows)
+    ScrollRows(c, i.n);
+}
+
+inline void Op00Dn(Chip8 &c, const Instruction &i) {
+    // 00Dn: SCU n (Scroll the display up n rows, XO-CHIP)
+    ScrollRows(c, -i.n);
+}
+
+inline void Op00FB(Chip8 &c, const Instruction &) {
+    // 00FB: SCR (Scroll the display right 4 pixels)
+    ScrollColumns(c, true);
+}
+
+inline void Op00FC(Chip8 &c, const Instruction &) {
+    // 00FC: SCL (Scroll the display left 4 pixels)
+    ScrollColumns(c, false);
+}
+
+inline void Op00FD(Chip8 &c, const Instruction &) {
+    // 00FD: EXIT (Stop the interpreter). The machine halts on it.
+    c.pc -= 2;
+    c.budget = 0;
+    c.idle = Idle::Halt;
+    c.stop_flag = true;
+}
+
+inline void Op00FE(Chip8 &c, const Instruction &) {
+    // 00FE: LOW (64x32 mode). Like Octo, changing mode clears the display.
+    c.gfx.Clear();
+    c.draw_flag = true;
+}
+
+inline void Op00FF(Chip8 &c, const Instruction &) {
+    // 00FF: HIGH (128x64 mode)
+    c.gfx.Clear();
+    c.gfx.hires = true;
+    c.draw_flag = true;
+}
+
+// The registers from Vx to Vy, counting down if x > y
+inline int RangeLength(const Instruction &i) { return std::abs(i.x - i.y) + 1; }
+inline int RangeRegister(const Instruction &i, const int n) {
+    return i.x <= i.y ? i.x + n : i.x - n;
+}
+
+inline void Op5xy2(Chip8 &c, const Instruction &i) {
+    // 5xy2: SAVE Vx - Vy (Store Vx through Vy in memory starting at
+    // location I. I is unchanged.)
+    const uint16_t start = c.index;
+    for (auto n = 0; n < RangeLength(i); n++) {
+        c.memory.Write(start + n, c.v[RangeRegister(i, n)]);
+    }
+    c.InvalidateDecoded(start, RangeLength(i));
+}
+
+inline void Op5xy3(Chip8 &c, const Instruction &i) {
+    // 5xy3: LOAD Vx - Vy (Read Vx through Vy from memory starting at
+    // location I. I is unchanged.)
+    for (auto n = 0; n < RangeLength(i); n++) {
+        c.v[RangeRegister(i, n)] = c.memory[c.index + n];
+    }
+}
+
+inline void OpF000(Chip8 &c, const Instruction &) {
+    // F000 nnnn: LD I, long addr (Set I = the word after the opcode)
+    c.index = (c.memory[c.pc] << 8) | c.memory[c.pc + 1];
+    c.pc += 2;
+}
+
+inline void OpFn01(Chip8 &c, const Instruction &i) {
+    // Fn01: PLANE n (Select the bitplanes drawn to, bit p = plane p)
+    c.plane_mask = i.x & 0x3;
+}
+
+inline void OpF002(Chip8 &c, const Instruction &) {
+    // F002: AUDIO (Load the 16 byte audio pattern at I)
+    for (auto n = 0; n < 16; n++) {
+        c.pattern[n] = c.memory[c.index + n];
+    }
+}
+
+inline void OpFx30(Chip8 &c, const Instruction &i) {
+    // Fx30: LD HF, Vx (Set I = location of big sprite for digit Vx)
+    c.index = 0xA0 + (c.v[i.x] & 0xF) * 10;
+}
+
+inline void OpFx3A(Chip8 &c, const Instruction &i) {
+    // Fx3A: PITCH Vx (Set the audio pattern's pitch = Vx)
+    c.pitch = c.v[i.x];
+}
+
+// Fx75/Fx85: SUPER-CHIP has 8 user flags, XO-CHIP 16
+template <typename Quirks> inline int FlagCount(const Instruction &i) {
+    constexpr int kFlags =
+        Quirks::extensions == Extensions::XoChip ? 16 : 8;
+    return std::min<int>(i.x + 1, kFlags);
+}
+
+template <typename Quirks>
+inline void OpFx75(Chip8 &c, const Instruction &i) {
+    // Fx75: LD R, Vx (Store V0 through Vx in the user flags)
+    std::copy_n(c.v, FlagCount<Quirks>(i), c.flags);
+}
+
+template <typename Quirks>
+inline void OpFx85(Chip8 &c, const Instruction &i) {
+    // Fx85: LD Vx, R (Read V0 through Vx from the user flags)
+    std::copy_n(c.flags, FlagCount<Quirks>(i), c.v);
+}
+
+// Idle loops. Timers and keys only change on timer ticks, and RunCycles never
+// runs a batch across one, so a loop that cannot exit before then is
+// fast-forwarded: the jump closing it drops the rest of the batch, or as
+// many whole iterations as fit in it.
+
+inline void Op1nnnSelf(Chip8 &c, const Instruction &i) {
+    // 1nnn jumping to itself: nothing changes until the machine is reset
+    c.pc = i.nnn;
+    c.budget = 0;
+    c.idle = Idle::Halt;
+}
+
+inline void Op1nnnDelayPoll(Chip8 &c, const Instruction &i) {
+    // 1nnn closing a Fx07 / 3xkk|4xkk / 1nnn delay timer poll: each 3 cycle
+    // iteration reads the same delay timer until the next tick. Unless Vx
+    // is stale from an earlier tick, in which case the next Fx07 must run.
+    c.pc = i.nnn;
+    if (c.v[c.memory[i.nnn] & 0xF] == c.DelayTimer()) {
+        c.budget %= 3;
+        c.idle = Idle::Timer;
+    }
+}
+
+// Whether `memory` holds a Fx07 / 3xkk|4xkk delay timer poll at `address`,
+// closed by a jump back to it right after. `memory` is indexed like an array
+// of `mask` + 1 bytes.
+template <typename Memory>
+inline bool IsDelayPoll(const Memory &memory, const uint16_t address,
+                        const uint16_t mask = 0xFFF) {
+    const uint16_t load =
+        (memory[address & mask] << 8) | memory[(address + 1) & mask];
+    const uint16_t skip =
+        (memory[(address + 2) & mask] << 8) | memory[(address + 3) & mask];
+    return (load & 0xF0FF) == 0xF007 &&
+           ((skip & 0xF000) == 0x3000 || (skip & 0xF000) == 0x4000) &&
+           (skip & 0x0F00) == (load & 0x0F00);
+}
+
+// Swap in an idle loop handler if the jump decoded at `address` closes one
+inline void MarkIdleLoop(Instruction &i, const Chip8 &c,
+                         const uint16_t address) {
+    if (i.handler != Op1nnn) {
+        return;
+    }
+    if (i.nnn == address) {
+        i.handler = Op1nnnSelf;
+        return;
+    }
+    if (i.nnn + 4 == address &&
+        IsDelayPoll(c.memory, i.nnn, c.memory.Size() - 1)) {
+        i.handler = Op1nnnDelayPoll;
+    }
+}
+
+inline void OpUnknown(Chip8 &, const Instruction &i) {
+    std::stringstream ss;
+    switch (i.opcode & 0xF000) {
+        case 0x8000:
+        case 0xE000:
+        case 0xF000: {
+            ss << "Unknown opcode [0x" << std::hex << (i.opcode & 0xF000)
+               << " family]: 0x" << i.opcode;
+            break;
+        }
+        default: {
+            ss << "Unknown or unimplemented opcode: 0x" << std::hex
+               << i.opcode;
+            break;
+        }
+    }
+    throw std::runtime_error(ss.str());
+}
+
+// The handler of a SUPER-CHIP or XO-CHIP instruction under Quirks, nullptr
+// for CHIP-8's own and unknown opcodes
+template <typename Quirks>
+Instruction::Handler ExtensionHandler(const uint16_t opcode) {
+    constexpr auto kLevel = Quirks::extensions;
+    constexpr bool kXo = kLevel == Extensions::XoChip;
+    if constexpr (kLevel == Extensions::None) {
+        return nullptr;
+    }
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if ((opcode & 0xFFF0) == 0x00C0) {
+                return Op00Cn;
+            } else if (kXo && (opcode & 0xFFF0) == 0x00D0) {
+                return Op00Dn;
+            }
+            switch (opcode) {
+                case 0x00FB:
+                    return Op00FB;
+                case 0x00FC:
+                    return Op00FC;
+                case 0x00FD:
+                    return Op00FD;
+                case 0x00FE:
+                    return Op00FE;
+                case 0x00FF:
+                    return Op00FF;
+                default:
+                    return nullptr;
+            }
+        case 0x5000:
+            if (kXo && (opcode & 0xF) == 0x2) {
+                return Op5xy2;
+            } else if (kXo && (opcode & 0xF) == 0x3) {
+                return Op5xy3;
+            }
+            return nullptr;
+        case 0xD000:
+            return opcode & 0xF ? nullptr : OpDxyn<Quirks>;
+        case 0xF000:
+            switch (opcode & 0xFF) {
+                case 0x00:
+                    return kXo && opcode == 0xF000 ? OpF000 : nullptr;
+                case 0x01:
+                    return kXo ? OpFn01 : nullptr;
+                case 0x02:
+                    return kXo && opcode == 0xF002 ? OpF002 : nullptr;
+                case 0x30:
+                    return OpFx30;
+                case 0x3A:
+                    return kXo ? OpFx3A : nullptr;
+                case 0x75:
+                    return OpFx75<Quirks>;
+                case 0x85:
+                    return OpFx85<Quirks>;
+                default:
+                    return nullptr;
+            }
+        default:
+            return nullptr;
+    }
+}
+
+// Split an opcode into its operands and pick its handler. Unknown opcodes
+// decode to OpUnknown, so bytes that are only data never throw unless run.
+template <typename Quirks> Instruction Decode(const uint16_t opcode) {
+    Instruction i;
+    i.opcode = opcode;
+    i.nnn = opcode & 0x0FFF;
+    i.kk = opcode & 0x00FF;
+    i.x = (opcode & 0x0F00) >> 8;
+    i.y = (opcode & 0x00F0) >> 4;
+    i.n = opcode & 0x000F;
+
+    if constexpr (Quirks::extensions != Extensions::None) {
+        if (const auto handler = ExtensionHandler<Quirks>(opcode)) {
+            i.handler = handler;
+            return i;
+        }
+    }
+
+    // The Switch-Case Monolith, now run once per address instead of per cycle
+    switch (opcode & 0xF000) {
+        case 0x0000: {
+            switch (i.kk) {
+                case 0xE0:
+                    i.handler = Op00E0;
+                    break;
+                case 0xEE:
+                    i.handler = Op00EE;
+                    break;
+                default:
+                    i.handler = Op0nnn;
+                    break;
+            }
+            break;
+        }
+        case 0x1000:
+            i.handler = Op1nnn;
+            break;
+        case 0x2000:
+            i.handler = Op2nnn;
+            break;
+        case 0x3000:
+            i.handler = Op3xkk<Quirks>;
+            break;
+        case 0x4000:
+            i.handler = Op4xkk<Quirks>;
+            break;
+        case 0x5000:
+            i.handler = Op5xy0<Quirks>;
+            break;
+        case 0x6000:
+            i.handler = Op6xkk;
+            break;
+        case 0x7000:
+            i.handler = Op7xkk;
+            break;
+        case 0x8000: {
+            switch (i.n) {
+                case 0x0:
+                    i.handler = Op8xy0;
+                    break;
+                case 0x1:
+                    i.handler = Op8xy1<Quirks>;
+                    break;
+                case 0x2:
+                    i.handler = Op8xy2<Quirks>;
+                    break;
+                case 0x3:
+                    i.handler = Op8xy3<Quirks>;
+                    break;
+                case 0x4:
+                    i.handler = Op8xy4;
+                    break;
+                case 0x5:
+                    i.handler = Op8xy5;
+                    break;
+                case 0x6:
+                    i.handler = Op8xy6<Quirks>;
+                    break;
+                case 0x7:
+                    i.handler = Op8xy7;
+                    break;
+                case 0xE:
+                    i.handler = Op8xyE<Quirks>;
+                    break;
+                default:
+                    i.handler = OpUnknown;
+                    break;
+            }
+            break;
+        }
+        case 0x9000:
+            i.handler = Op9xy0<Quirks>;
+            break;
+        case 0xA000:
+            i.handler = OpAnnn;
+            break;
+        case 0xB000:
+            i.handler = OpBnnn<Quirks>;
+            break;
+        case 0xC000:
+            i.handler = OpCxkk;
+            break;
+        case 0xD000:
+            i.handler = OpDxyn<Quirks>;
+            break;
+        case 0xE000: {
+            switch (i.kk) {
+                case 0x9E:
+                    i.handler = OpEx9E<Quirks>;
+                    break;
+                case 0xA1:
+                    i.handler = OpExA1<Quirks>;
+                    break;
+                default:
+                    i.handler = OpUnknown;
+                    break;
+            }
+            break;
+        }
+        case 0xF000: {
+            switch (i.kk) {
+                case 0x07:
+                    i.handler = OpFx07;
+                    break;
+                case 0x0A:
+                    i.handler = OpFx0A;
+                    break;
+                case 0x15:
+                    i.handler = OpFx15;
+                    break;
+                case 0x18:
+                    i.handler = OpFx18;
+                    break;
+                case 0x1E:
+                    i.handler = OpFx1E;
+                    break;
+                case 0x29:
+                    i.handler = OpFx29;
+                    break;
+                case 0x33:
+                    i.handler = OpFx33;
+                    break;
+                case 0x55:
+                    i.handler = OpFx55<Quirks>;
+                    break;
+                case 0x65:
+                    i.handler = OpFx65<Quirks>;
+                    break;
+                default:
+                    i.handler = OpUnknown;
+                    break;
+            }
+            break;
+        }
+        default:
+            i.handler = OpUnknown;
+            break;
+    }
+    return i;
+}
+
+inline Instruction Decode(const Profile profile, const uint16_t opcode) {
+    return WithQuirks(profile, [opcode]<typename Quirks>(Quirks) {
+        return Decode<Quirks>(opcode);
+    });
+}
+
+#endif // CHIP_8_OPCODES_H
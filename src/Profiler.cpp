@@ -0,0 +1,151 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+constexpr const char *kFamilyNames[Profiler::kFamilies] = {
+    "00E0", "00EE", "0nnn", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk",
+    "7xkk", "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7",
+    "8xyE", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E", "ExA1", "Fx07",
+    "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx33", "Fx55", "Fx65", "00Cn",
+    "00Dn", "00FB", "00FC", "00FD", "00FE", "00FF", "5xy2", "5xy3", "F000",
+    "Fn01", "F002", "Fx30", "Fx3A", "Fx75", "Fx85", "????",
+};
+
+constexpr const char *kSectionNames[] = {"emulate", "render", "input",
+                                         "sleep"};
+static_assert(std::size(kSectionNames) == static_cast<int>(Section::Count));
+
+// The `count` largest of `values`, as indices, largest first
+template <size_t N>
+std::vector<int> Top(const uint64_t (&values)[N], const size_t count) {
+    std::vector<int> order;
+    for (size_t i = 0; i < N; i++) {
+        if (values[i]) {
+            order.push_back(static_cast<int>(i));
+        }
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](const int a, const int b) {
+                         return values[a] > values[b];
+                     });
+    order.resize(std::min(order.size(), count));
+    return order;
+}
+} // namespace
+
+Profiler::Profiler() : started(Clock::now()), frame_start(started) {}
+
+void Profiler::EndFrame(const uint64_t cycles) {
+    const auto now = Clock::now();
+    frame_ms.push_back(std::chrono::duration<float, std::milli>(
+                           now - frame_start)
+                           .count());
+    frame_start = now;
+    this->cycles += cycles;
+}
+
+const char *Profiler::FamilyName(const int family) {
+    return kFamilyNames[family];
+}
+
+double Profiler::AchievedHz() const {
+    const double elapsed =
+        std::chrono::duration<double>(Clock::now() - started).count();
+    return elapsed > 0 ? cycles / elapsed : 0;
+}
+
+// The value at `fraction` (0.5 = median) of the way through `values`
+double Profiler::Percentile(const std::vector<float> &values,
+                            const double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::vector<float> sorted = values;
+    const auto at = static_cast<size_t>(fraction * (sorted.size() - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + at, sorted.end());
+    return sorted[at];
+}
+
+std::string Profiler::Status(const double target_hz) const {
+    char line[128];
+    const double hz = AchievedHz();
+    std::snprintf(line, sizeof(line),
+                  "%.0f Hz of %.0f (%.0f%%)  frame p50 %.1f ms  p99 %.1f ms"
+                  "  input p50 %.1f ms",
+                  hz, target_hz, 100 * hz / target_hz,
+                  Percentile(frame_ms, 0.5), Percentile(frame_ms, 0.99),
+                  Percentile(latency_ms, 0.5));
+    return line;
+}
+
+bool Profiler::Write(const char *filename, const double target_hz) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not write file " << filename << std::endl;
+        return false;
+    }
+
+    uint64_t executed = 0;
+    for (const auto count : families) {
+        executed += count;
+    }
+    const double elapsed =
+        std::chrono::duration<double>(Clock::now() - started).count();
+    char line[128];
+
+    file << "# Speed\n";
+    std::snprintf(line, sizeof(line),
+                  "target %.0f Hz, achieved %.0f Hz (%.1f%%) over %.2f s\n"
+                  "%llu cycles emulated, %llu instructions executed\n",
+                  target_hz, AchievedHz(), 100 * AchievedHz() / target_hz,
+                  elapsed, static_cast<unsigned long long>(cycles),
+                  static_cast<unsigned long long>(executed));
+    file << line;
+
+    file << "\n# Host time\n";
+    for (auto i = 0; i < static_cast<int>(Section::Count); i++) {
+        std::snprintf(line, sizeof(line), "%-8s %9.3f s %5.1f%%\n",
+                      kSectionNames[i], seconds[i],
+                      elapsed > 0 ? 100 * seconds[i] / elapsed : 0);
+        file << line;
+    }
+
+    file << "\n# Frame time (ms, sleep included)\n";
+    std::snprintf(line, sizeof(line),
+                  "frames %zu  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+                  frame_ms.size(), Percentile(frame_ms, 0.5),
+                  Percentile(frame_ms, 0.9), Percentile(frame_ms, 0.99),
+                  Percentile(frame_ms, 1));
+    file << line;
+
+    file << "\n# Input latency (ms, key press to the first frame with it)\n";
+    std::snprintf(line, sizeof(line),
+                  "presses %zu  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+                  latency_ms.size(), Percentile(latency_ms, 0.5),
+                  Percentile(latency_ms, 0.9), Percentile(latency_ms, 0.99),
+                  Percentile(latency_ms, 1));
+    file << line;
+
+    file << "\n# Opcode families\n";
+    for (const auto family : Top(families, kFamilies)) {
+        std::snprintf(line, sizeof(line), "%s %14llu %5.1f%%\n",
+                      kFamilyNames[family],
+                      static_cast<unsigned long long>(families[family]),
+                      100.0 * families[family] / executed);
+        file << line;
+    }
+
+    file << "\n# Hottest addresses\n";
+    for (const auto address : Top(addresses, 32)) {
+        std::snprintf(line, sizeof(line), "%03X %14llu %5.1f%%\n", address,
+                      static_cast<unsigned long long>(addresses[address]),
+                      100.0 * addresses[address] / executed);
+        file << line;
+    }
+    return true;
+}
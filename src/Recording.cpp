@@ -0,0 +1,231 @@
+#include "Recording.h"
+#include "Chip8.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+// File layout, integers little-endian:
+//   "C8RC", version (1 byte), profile (1), clock_hz (4), seed (8),
+//   rom_hash (8), then per key event the cycles since the previous one
+//   (LEB128) followed by the key, plus kDown if pressed (1 byte). A key byte
+//   of 0xFF ends the file, its delta leading to the end of the session.
+// Version 1 held keys for a number of timer ticks instead: each press was
+// followed by a ticks byte, and is read as a press and its release.
+namespace {
+constexpr char kMagic[4] = {'C', '8', 'R', 'C'};
+constexpr uint8_t kVersion = 2;
+constexpr uint8_t kDown = 0x10;
+constexpr uint8_t kEnd = 0xFF;
+
+void PutFixed(std::string &out, uint64_t value, const int bytes) {
+    for (auto i = 0; i < bytes; i++, value >>= 8) {
+        out.push_back(static_cast<char>(value & 0xFF));
+    }
+}
+
+void PutVarint(std::string &out, uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Reads from a loaded file, throwing if it ends early
+class Reader {
+public:
+    explicit Reader(const std::string &data) : data(data) {}
+
+    uint8_t Byte() {
+        if (at == data.size()) {
+            throw std::runtime_error("truncated");
+        }
+        return static_cast<uint8_t>(data[at++]);
+    }
+    uint64_t Fixed(const int bytes) {
+        uint64_t value = 0;
+        for (auto i = 0; i < bytes; i++) {
+            value |= uint64_t{Byte()} << 8 * i;
+        }
+        return value;
+    }
+    uint64_t Varint() {
+        uint64_t value = 0;
+        for (auto shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = Byte();
+            value |= uint64_t{byte & 0x7Fu} << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("bad varint");
+    }
+
+private:
+    const std::string &data;
+    size_t at{};
+};
+
+// Version 1 presses as presses and releases. A key was held until the tick
+// `ticks` after the press, reached on the first cycle of that tick, and a
+// press while held restarted the count.
+class TimedPresses {
+public:
+    TimedPresses(std::vector<KeyEvent> &events, const uint32_t clock_hz)
+        : events(events), clock_hz(clock_hz) {}
+
+    void Press(const uint64_t cycle, const uint8_t key, const uint8_t ticks) {
+        ReleaseUntil(cycle);
+        events.push_back({cycle, key, true});
+        const uint64_t tick = cycle * 60 / clock_hz + ticks;
+        release[key] = std::max(cycle, (tick * clock_hz + 59) / 60);
+        held |= 1 << key;
+        ReleaseUntil(cycle);
+    }
+
+    // Emit the releases due up to `cycle`, earliest first
+    void ReleaseUntil(const uint64_t cycle) {
+        for (;;) {
+            auto next = -1;
+            for (auto key = 0; key < 16; key++) {
+                if (held >> key & 1 && release[key] <= cycle &&
+                    (next < 0 || release[key] < release[next])) {
+                    next = key;
+                }
+            }
+            if (next < 0) {
+                return;
+            }
+            events.push_back(
+                {release[next], static_cast<uint8_t>(next), false});
+            held &= ~(1 << next);
+        }
+    }
+
+private:
+    std::vector<KeyEvent> &events;
+    uint32_t clock_hz;
+    uint64_t release[16]{};
+    uint16_t held{};
+};
+} // namespace
+
+Recording::Recording(const Chip8 &chip, const uint64_t seed)
+    : profile(chip.profile), clock_hz(chip.clock_hz), seed(seed),
+      rom_hash(chip.ProgramHash()), end(chip.cycles) {}
+
+void Recording::SetKey(Chip8 &chip, const uint8_t key, const bool down) {
+    events.push_back({chip.cycles, static_cast<uint8_t>(key & 0xF), down});
+    chip.SetKey(key, down);
+}
+
+void Recording::Finish(const Chip8 &chip) { end = chip.cycles; }
+
+bool Recording::Save(const char *filename) const {
+    std::string out(kMagic, sizeof(kMagic));
+    PutFixed(out, kVersion, 1);
+    PutFixed(out, static_cast<uint8_t>(profile), 1);
+    PutFixed(out, clock_hz, 4);
+    PutFixed(out, seed, 8);
+    PutFixed(out, rom_hash, 8);
+    uint64_t cycle = 0;
+    for (const auto &event : events) {
+        PutVarint(out, event.cycle - cycle);
+        PutFixed(out, event.key | (event.down ? kDown : 0), 1);
+        cycle = event.cycle;
+    }
+    PutVarint(out, end - cycle);
+    PutFixed(out, kEnd, 1);
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.write(out.data(), static_cast<std::streamsize>(out.size()))) {
+        std::cerr << "Error: Could not write file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Recording::Load(const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    const std::string data(std::istreambuf_iterator<char>(file), {});
+
+    try {
+        Reader in(data);
+        for (const char c : kMagic) {
+            if (in.Byte() != static_cast<uint8_t>(c)) {
+                throw std::runtime_error("not a recording");
+            }
+        }
+        const uint8_t version = in.Byte();
+        if (version != 1 && version != kVersion) {
+            throw std::runtime_error("unsupported version");
+        }
+        const uint8_t quirks = in.Byte();
+        if (quirks > static_cast<uint8_t>(Profile::XoChip)) {
+            throw std::runtime_error("unknown quirk profile");
+        }
+        profile = static_cast<Profile>(quirks);
+        clock_hz = static_cast<uint32_t>(in.Fixed(4));
+        if (clock_hz == 0) {
+            throw std::runtime_error("clock speed must be positive");
+        }
+        seed = in.Fixed(8);
+        rom_hash = in.Fixed(8);
+        events.clear();
+        TimedPresses presses(events, clock_hz);
+        for (uint64_t cycle = 0;;) {
+            cycle += in.Varint();
+            const uint8_t key = in.Byte();
+            if (key == kEnd) {
+                presses.ReleaseUntil(cycle);
+                end = cycle;
+                break;
+            }
+            if (version == 1) {
+                presses.Press(cycle, key & 0xF, in.Byte());
+            } else {
+                events.push_back({cycle, static_cast<uint8_t>(key & 0xF),
+                                  (key & kDown) != 0});
+            }
+        }
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Error: " << filename << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Recording::Replay(Chip8 &chip, uint64_t until) const {
+    if (chip.cycles == 0) {
+        if (chip.profile != profile) {
+            throw std::runtime_error("Replay needs a fresh machine with the "
+                                     "recorded quirk profile");
+        }
+        if (chip.ProgramHash() != rom_hash) {
+            throw std::runtime_error(
+                "Recording was made with a different ROM");
+        }
+        chip.clock_hz = clock_hz;
+        chip.Seed(seed);
+    }
+
+    // Events before chip.cycles were applied by an earlier call
+    until = std::min(until, end);
+    auto event = std::lower_bound(events.begin(), events.end(), chip.cycles,
+                                  [](const KeyEvent &e, const uint64_t cycle) {
+                                      return e.cycle < cycle;
+                                  });
+    for (; event != events.end() && (event->cycle < until || until == end);
+         ++event) {
+        chip.RunCycles(event->cycle - chip.cycles);
+        chip.SetKey(event->key, event->down);
+    }
+    chip.RunCycles(until - chip.cycles);
+}
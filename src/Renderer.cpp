@@ -0,0 +1,109 @@
+#include "Renderer.h"
+
+#include <bit>
+#include <ncurses.h>
+
+namespace {
+// Colour pair for a foreground and background pixel value (the planes lit)
+int Pair(const int fg, const int bg) { return 1 + fg * 4 + bg; }
+} // namespace
+
+TerminalRenderer::TerminalRenderer(const bool half_blocks)
+    : half_blocks(half_blocks) {
+    // Plane 0 alone keeps the terminal's own colours; the rest get a pair
+    // for every foreground and background combination
+    if (has_colors() && start_color() == OK) {
+        use_default_colors();
+        constexpr short kColors[4] = {-1, COLOR_WHITE, COLOR_CYAN,
+                                      COLOR_YELLOW};
+        for (auto fg = 0; fg < 4; fg++) {
+            for (auto bg = 0; bg < 4; bg++) {
+                init_pair(Pair(fg, bg), kColors[fg], kColors[bg]);
+            }
+        }
+        colors = true;
+    }
+}
+
+void TerminalRenderer::Invalidate() { valid = false; }
+
+void TerminalRenderer::Present(const Display &gfx) {
+    const int lines = half_blocks ? 2 : 1; // Display rows per terminal row
+    const int rows = gfx.Height() / lines;
+    const int stride = gfx.Stride();
+
+    // Re-center and repaint everything when the terminal size or the
+    // resolution changes
+    int y, x;
+    getmaxyx(stdscr, y, x);
+    if (!valid || y != term_y || x != term_x || gfx.hires != shown.hires ||
+        gfx.Planes() != shown.Planes()) {
+        term_y = y;
+        term_x = x;
+        start_y = (term_y - rows) / 2;
+        start_x = (term_x - gfx.Width()) / 2;
+        clear();
+        for (auto row = 0; row < rows; row++) {
+            for (auto col = 0; col < gfx.Width(); col++) {
+                DrawCell(col, row, gfx);
+            }
+        }
+    } else {
+        bool changed = false;
+        for (auto row = 0; row < rows; row++) {
+            for (auto word = 0; word < stride; word++) {
+                // A set bit marks a column whose cell changed
+                uint64_t diff = 0;
+                for (auto line = 0; line < lines; line++) {
+                    const int at = (row * lines + line) * stride + word;
+                    for (auto p = 0; p < Display::kPlanes; p++) {
+                        diff |= gfx.Word(p, at) ^ shown.Word(p, at);
+                    }
+                }
+                changed |= diff != 0;
+                while (diff) {
+                    const int col = std::countl_zero(diff);
+                    DrawCell(64 * word + col, row, gfx);
+                    diff &= ~(1ULL << 63 >> col);
+                }
+            }
+        }
+        if (!changed) {
+            return;
+        }
+    }
+
+    shown = gfx;
+    valid = true;
+    refresh();
+}
+
+void TerminalRenderer::DrawCell(const int x, const int row,
+                                const Display &gfx) const {
+    if (!half_blocks) {
+        const int pixel = gfx.Pixel(x, row);
+        if (colors && pixel > 1) {
+            attron(COLOR_PAIR(Pair(pixel, 0)));
+            mvaddch(start_y + row, start_x + x, '#');
+            attroff(COLOR_PAIR(Pair(pixel, 0)));
+        } else {
+            mvaddch(start_y + row, start_x + x, pixel ? '#' : ' ');
+        }
+        return;
+    }
+
+    // Upper and lower pixel of the cell
+    static const char *const blocks[] = {" ", "▄", "▀", "█"};
+    const int top = gfx.Pixel(x, 2 * row);
+    const int bottom = gfx.Pixel(x, 2 * row + 1);
+    if (!colors || (top | bottom) <= 1) {
+        mvaddstr(start_y + row, start_x + x,
+                 blocks[(top != 0) << 1 | (bottom != 0)]);
+        return;
+    }
+    // The lit half in its colour, over the other half's
+    const int pair = top ? Pair(top, bottom) : Pair(bottom, 0);
+    attron(COLOR_PAIR(pair));
+    mvaddstr(start_y + row, start_x + x, top ? "▀" : "▄");
+    attroff(COLOR_PAIR(pair));
+}
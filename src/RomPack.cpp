@@ -0,0 +1,173 @@
+#include "RomPack.h"
+#include "Chip8.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// File layout, integers little-endian:
+//   "C8PK", version (1 byte), 3 reserved, ROM count (4), 4 reserved, then
+//   the index: per ROM its hash (8), data offset (4), name offset (4),
+//   clock_hz (4), size (2), name length (1) and profile (1), sorted by hash.
+//   Names and data follow, at the offsets the index gives.
+namespace {
+constexpr char kMagic[4] = {'C', '8', 'P', 'K'};
+constexpr uint8_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kEntrySize = 24;
+
+void PutFixed(std::string &out, uint64_t value, const int bytes) {
+    for (auto i = 0; i < bytes; i++, value >>= 8) {
+        out.push_back(static_cast<char>(value & 0xFF));
+    }
+}
+
+uint64_t GetFixed(const uint8_t *in, const int bytes) {
+    uint64_t value = 0;
+    for (auto i = 0; i < bytes; i++) {
+        value |= uint64_t{in[i]} << 8 * i;
+    }
+    return value;
+}
+} // namespace
+
+uint64_t RomPack::Hash(const uint8_t *data, const size_t size) {
+    uint64_t hash = 0xCBF29CE484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3;
+    }
+    return hash;
+}
+
+bool RomPack::Open(const char *filename) {
+    roms.clear();
+    if (!file.Open(filename)) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+
+    // Check every entry up front, so ROMs can be used without further checks
+    try {
+        const uint8_t *data = file.Data();
+        const size_t size = file.Size();
+        if (size < kHeaderSize || !std::equal(kMagic, kMagic + 4, data)) {
+            throw std::runtime_error("not a ROM pack");
+        }
+        if (data[4] != kVersion) {
+            throw std::runtime_error("unsupported version");
+        }
+        const size_t count = GetFixed(data + 8, 4);
+        if (count > (size - kHeaderSize) / kEntrySize) {
+            throw std::runtime_error("truncated index");
+        }
+        roms.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t *entry = data + kHeaderSize + i * kEntrySize;
+            PackedRom rom;
+            rom.hash = GetFixed(entry, 8);
+            const size_t offset = GetFixed(entry + 8, 4);
+            const size_t name = GetFixed(entry + 12, 4);
+            rom.clock_hz = static_cast<uint32_t>(GetFixed(entry + 16, 4));
+            rom.size = GetFixed(entry + 20, 2);
+            const size_t name_length = entry[22];
+            if (entry[23] > static_cast<uint8_t>(Profile::XoChip)) {
+                throw std::runtime_error("unknown quirk profile");
+            }
+            rom.profile = static_cast<Profile>(entry[23]);
+            if (offset > size || rom.size > size - offset ||
+                name > size || name_length > size - name) {
+                throw std::runtime_error("entry outside the file");
+            }
+            if (rom.size > Chip8::MaxRomSize(rom.profile)) {
+                throw std::runtime_error("ROM too large");
+            }
+            if (!roms.empty() && rom.hash < roms.back().hash) {
+                throw std::runtime_error("index out of order");
+            }
+            rom.data = data + offset;
+            rom.name = {reinterpret_cast<const char *>(data + name),
+                        name_length};
+            roms.push_back(rom);
+        }
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Error: " << filename << ": " << e.what() << std::endl;
+        roms.clear();
+        return false;
+    }
+    return true;
+}
+
+bool RomPack::Write(const char *filename, std::vector<PackedRom> roms) {
+    for (auto &rom : roms) {
+        if (rom.size > Chip8::MaxRomSize(rom.profile)) {
+            std::cerr << "Error: " << rom.name << " is " << rom.size
+                      << " bytes, only " << Chip8::MaxRomSize(rom.profile)
+                      << " fit" << std::endl;
+            return false;
+        }
+        rom.hash = Hash(rom.data, rom.size);
+        rom.name = rom.name.substr(0, 0xFF);
+    }
+    std::stable_sort(roms.begin(), roms.end(),
+                     [](const PackedRom &a, const PackedRom &b) {
+                         return a.hash < b.hash;
+                     });
+
+    std::string out(kMagic, sizeof(kMagic));
+    PutFixed(out, kVersion, 1);
+    PutFixed(out, 0, 3);
+    PutFixed(out, roms.size(), 4);
+    PutFixed(out, 0, 4);
+
+    // Names, then data, after the index
+    size_t name = kHeaderSize + roms.size() * kEntrySize;
+    size_t offset = name;
+    for (const auto &rom : roms) {
+        offset += rom.name.size();
+    }
+    size_t end = offset;
+    for (const auto &rom : roms) {
+        end += rom.size;
+    }
+    if (end > UINT32_MAX) {
+        std::cerr << "Error: " << filename << ": more than 4 GiB of ROMs"
+                  << std::endl;
+        return false;
+    }
+    for (const auto &rom : roms) {
+        PutFixed(out, rom.hash, 8);
+        PutFixed(out, offset, 4);
+        PutFixed(out, name, 4);
+        PutFixed(out, rom.clock_hz, 4);
+        PutFixed(out, rom.size, 2);
+        PutFixed(out, rom.name.size(), 1);
+        PutFixed(out, static_cast<uint8_t>(rom.profile), 1);
+        name += rom.name.size();
+        offset += rom.size;
+    }
+    for (const auto &rom : roms) {
+        out += rom.name;
+    }
+    for (const auto &rom : roms) {
+        out.append(reinterpret_cast<const char *>(rom.data), rom.size);
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.write(out.data(), static_cast<std::streamsize>(out.size()))) {
+        std::cerr << "Error: Could not write file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const PackedRom *RomPack::Find(const uint64_t hash) const {
+    const auto found = std::lower_bound(
+        roms.begin(), roms.end(), hash,
+        [](const PackedRom &rom, const uint64_t key) {
+            return rom.hash < key;
+        });
+    return found != roms.end() && found->hash == hash ? &*found : nullptr;
+}
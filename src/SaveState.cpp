@@ -0,0 +1,316 @@
+#include "SaveState.h"
+#include "Chip8.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+constexpr char kMagic[4] = {'C', '8', 'S', 'S'};
+// 2: keypad as a bitmask. 3: SUPER-CHIP / XO-CHIP state, memory by profile.
+constexpr uint8_t kVersion = 3;
+
+// Sequential little-endian fields of the image, after memory
+class Writer {
+public:
+    explicit Writer(uint8_t *bytes) : at(bytes) {}
+
+    template <typename T> void Put(const T value) {
+        for (size_t i = 0; i < sizeof(T); i++) {
+            *at++ = static_cast<uint8_t>(static_cast<uint64_t>(value) >> 8 * i);
+        }
+    }
+
+    uint8_t *End() const { return at; }
+
+private:
+    uint8_t *at;
+};
+
+class Reader {
+public:
+    explicit Reader(const uint8_t *bytes) : at(bytes) {}
+
+    template <typename T> void Get(T &value) {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < sizeof(T); i++) {
+            bits |= uint64_t{*at++} << 8 * i;
+        }
+        value = static_cast<T>(bits);
+    }
+
+private:
+    const uint8_t *at;
+};
+
+// Image layout: memory, the display (both planes, all their words, then the
+// resolution), then the fields in the order below starting with clock_hz,
+// padded to whole words
+constexpr size_t kDisplaySize =
+    Display::kPlanes * Display::kWords * sizeof(uint64_t) + 8;
+constexpr size_t kRegistersSize = 128; // 126 used
+
+size_t RegistersAt(const Profile profile) {
+    return MemorySize(profile) + kDisplaySize;
+}
+
+// The clock speed an image was taken at, 0 only if it is corrupt
+uint32_t ClockSpeed(const StateImage &image, const Profile profile) {
+    uint32_t clock_hz;
+    Reader(reinterpret_cast<const uint8_t *>(image.data()) +
+           RegistersAt(profile))
+        .Get(clock_hz);
+    return clock_hz;
+}
+
+// The stack pointer an image holds, past 16 only if it is corrupt
+uint8_t StackPointer(const StateImage &image, const Profile profile) {
+    Reader in(reinterpret_cast<const uint8_t *>(image.data()) +
+              RegistersAt(profile));
+    uint32_t clock_hz;
+    uint64_t cycles;
+    uint8_t v;
+    uint16_t index, pc;
+    uint8_t sp;
+    in.Get(clock_hz);
+    in.Get(cycles);
+    for (auto x = 0; x < 16; x++) {
+        in.Get(v);
+    }
+    in.Get(index);
+    in.Get(pc);
+    in.Get(sp);
+    return sp;
+}
+} // namespace
+
+size_t StateWords(const Profile profile) {
+    return (RegistersAt(profile) + kRegistersSize) / 8;
+}
+
+void CaptureState(const Chip8 &chip, StateImage &image) {
+    const size_t size = chip.memory.Size();
+    image.resize(StateWords(chip.profile));
+    auto *const bytes = reinterpret_cast<uint8_t *>(image.data());
+    chip.memory.Read(0, bytes, size);
+    Writer display(bytes + size);
+    for (auto p = 0; p < Display::kPlanes; p++) {
+        for (auto word = 0; word < Display::kWords; word++) {
+            display.Put(word < chip.gfx.Words() ? chip.gfx.Word(p, word)
+                                                : uint64_t{0});
+        }
+    }
+    display.Put(uint64_t{chip.gfx.hires});
+
+    Writer out(bytes + RegistersAt(chip.profile));
+    out.Put(chip.clock_hz);
+    out.Put(chip.cycles);
+    for (const auto value : chip.v) {
+        out.Put(value);
+    }
+    out.Put(chip.index);
+    out.Put(chip.pc);
+    out.Put(chip.sp);
+    for (const auto address : chip.stack) {
+        out.Put(address);
+    }
+    out.Put(chip.delay_expiry);
+    out.Put(chip.sound_expiry);
+    out.Put(chip.sound_playing);
+    out.Put(chip.keypad);
+    out.Put(chip.rng);
+    out.Put(chip.plane_mask);
+    for (const auto value : chip.flags) {
+        out.Put(value);
+    }
+    for (const auto value : chip.pattern) {
+        out.Put(value);
+    }
+    out.Put(chip.pitch);
+
+    // Zero the padding, so equal states have equal images
+    std::memset(out.End(), 0, bytes + image.size() * 8 - out.End());
+}
+
+void RestoreState(Chip8 &chip, const StateImage &image) {
+    const auto *const bytes = reinterpret_cast<const uint8_t *>(image.data());
+
+    // Only drop decoded code where memory actually changes, so that a
+    // rewind doesn't have to decode and translate everything again
+    const size_t size = chip.memory.Size();
+    std::vector<uint8_t> memory(size);
+    chip.memory.Read(0, memory.data(), size);
+    for (size_t start = 0; start < size;) {
+        if (std::memcmp(&memory[start], bytes + start, 8) == 0) {
+            start += 8;
+            continue;
+        }
+        auto end = start + 8;
+        while (end < size &&
+               std::memcmp(&memory[end], bytes + end, 8) != 0) {
+            end += 8;
+        }
+        chip.memory.Write(start, bytes + start, end - start);
+        chip.InvalidateDecoded(start, end - start);
+        start = end;
+    }
+
+    // The resolution comes after the planes, so read them whole first
+    Reader display(bytes + size);
+    uint64_t planes[Display::kPlanes][Display::kWords];
+    for (auto &plane : planes) {
+        for (auto &word : plane) {
+            display.Get(word);
+        }
+    }
+    uint64_t hires;
+    display.Get(hires);
+    chip.gfx.Clear();
+    chip.gfx.hires = hires != 0 && chip.gfx.Extended();
+    for (auto p = 0; p < chip.gfx.Planes(); p++) {
+        std::copy_n(planes[p], chip.gfx.Words(), chip.gfx.Plane(p));
+    }
+
+    Reader in(bytes + RegistersAt(chip.profile));
+    in.Get(chip.clock_hz);
+    in.Get(chip.cycles);
+    for (auto &value : chip.v) {
+        in.Get(value);
+    }
+    in.Get(chip.index);
+    in.Get(chip.pc);
+    in.Get(chip.sp);
+    for (auto &address : chip.stack) {
+        in.Get(address);
+    }
+    in.Get(chip.delay_expiry);
+    in.Get(chip.sound_expiry);
+    in.Get(chip.sound_playing);
+    in.Get(chip.keypad);
+    in.Get(chip.rng);
+    in.Get(chip.plane_mask);
+    for (auto &value : chip.flags) {
+        in.Get(value);
+    }
+    for (auto &value : chip.pattern) {
+        in.Get(value);
+    }
+    in.Get(chip.pitch);
+
+    chip.tick = chip.cycles * 60 / chip.clock_hz;
+    chip.idle = Idle::None;
+    chip.stop_flag = false;
+    chip.draw_flag = true;
+}
+
+bool SaveState(const Chip8 &chip, const char *filename) {
+    StateImage image;
+    CaptureState(chip, image);
+    const char header[6] = {kMagic[0], kMagic[1], kMagic[2], kMagic[3],
+                            static_cast<char>(kVersion),
+                            static_cast<char>(chip.profile)};
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.write(header, sizeof(header)) ||
+        !file.write(reinterpret_cast<const char *>(image.data()),
+                    static_cast<std::streamsize>(image.size() * 8))) {
+        std::cerr << "Error: Could not write file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool LoadState(Chip8 &chip, const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+
+    // The image is as large as the profile's, checked first
+    char header[6];
+    if (!file.read(header, sizeof(header)) ||
+        std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        std::cerr << "Error: " << filename << ": not a save state" << std::endl;
+        return false;
+    }
+    if (header[4] != kVersion) {
+        std::cerr << "Error: " << filename << ": unsupported version"
+                  << std::endl;
+        return false;
+    }
+    if (header[5] != static_cast<char>(chip.profile)) {
+        std::cerr << "Error: " << filename << ": saved with quirk profile "
+                  << ProfileName(static_cast<Profile>(header[5])) << std::endl;
+        return false;
+    }
+    StateImage image(StateWords(chip.profile));
+    if (!file.read(reinterpret_cast<char *>(image.data()),
+                   static_cast<std::streamsize>(image.size() * 8)) ||
+        ClockSpeed(image, chip.profile) == 0 ||
+        StackPointer(image, chip.profile) > 16) {
+        std::cerr << "Error: " << filename << ": corrupt" << std::endl;
+        return false;
+    }
+    RestoreState(chip, image);
+    return true;
+}
+
+RewindBuffer::RewindBuffer(const size_t budget) : budget(budget) {}
+
+void RewindBuffer::Push(const Chip8 &chip) {
+    if (empty) {
+        CaptureState(chip, latest);
+        empty = false;
+        return;
+    }
+    CaptureState(chip, current);
+
+    // XOR with the newest snapshot, as runs of unchanged words (skipped)
+    // and changed ones (kept). A header word holds both run lengths.
+    std::vector<uint64_t> delta;
+    for (size_t i = 0; i < current.size();) {
+        const size_t start = i;
+        while (i < current.size() && current[i] == latest[i]) {
+            i++;
+        }
+        const size_t same = i - start;
+        const size_t header = delta.size();
+        delta.push_back(0);
+        while (i < current.size() && current[i] != latest[i]) {
+            delta.push_back(current[i] ^ latest[i]);
+            i++;
+        }
+        delta[header] = same << 32 | (delta.size() - header - 1);
+    }
+    latest.swap(current);
+
+    bytes += delta.size() * sizeof(uint64_t);
+    deltas.push_back(std::move(delta));
+    while (bytes > budget && !deltas.empty()) {
+        bytes -= deltas.front().size() * sizeof(uint64_t);
+        deltas.pop_front();
+    }
+}
+
+bool RewindBuffer::Rewind(Chip8 &chip) {
+    if (deltas.empty()) {
+        return false;
+    }
+
+    const std::vector<uint64_t> &delta = deltas.back();
+    size_t i = 0;
+    for (size_t at = 0; at < delta.size();) {
+        const uint64_t header = delta[at++];
+        i += header >> 32;
+        for (auto changed = header & 0xFFFFFFFF; changed--;) {
+            latest[i++] ^= delta[at++];
+        }
+    }
+    bytes -= delta.size() * sizeof(uint64_t);
+    deltas.pop_back();
+
+    RestoreState(chip, latest);
+    return true;
+}
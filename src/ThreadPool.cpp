@@ -0,0 +1,58 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <thread>
+
+ThreadPool::ThreadPool(const unsigned threads)
+    : queues(threads ? threads
+                     : std::max(1u, std::thread::hardware_concurrency())) {}
+
+void ThreadPool::Run(std::vector<Task> tasks) {
+    const auto count = static_cast<unsigned>(queues.size());
+    for (size_t i = 0; i < tasks.size(); i++) {
+        queues[i % count].tasks.push_back(std::move(tasks[i]));
+    }
+
+    // The calling thread is worker 0
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < count; i++) {
+        workers.emplace_back(&ThreadPool::Work, this, i);
+    }
+    Work(0);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Work(const unsigned self) {
+    // No task is added once Run starts, so all queues being empty means the
+    // remaining tasks are already running elsewhere
+    Task task;
+    while (Pop(self, task) || Steal(self, task)) {
+        task();
+    }
+}
+
+bool ThreadPool::Pop(const unsigned self, Task &task) {
+    Queue &queue = queues[self];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::Steal(const unsigned self, Task &task) {
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue &victim = queues[(self + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,408 @@
+#include "Analysis.h"
+#include "Chip8.h"
+#include "FrameScheduler.h"
+#include "FrameSink.h"
+#include "ParseNumber.h"
+#include "Recording.h"
+#include "RomPack.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+// A machine with a job's program loaded and prewarmed, made by the first
+// run of it and forked by the others
+struct Prepared {
+    std::once_flag once;
+    std::shared_ptr<const Chip8> machine; // nullptr if it failed to load
+};
+
+// A ROM and the configuration to run it with
+struct Job {
+    std::string rom;
+    std::string quirks{"modern"};
+    std::string engine{"interpreter"};
+    uint32_t hz{700};
+    uint64_t cycles{10'000'000}; // Upper bound, the run may halt sooner
+    uint64_t seed{};
+    std::shared_ptr<const Recording> replay; // Replaces the options above
+    std::string trace;                       // Frame hashes written here
+    std::shared_ptr<const std::vector<uint64_t>> golden; // Hashes to match
+    std::shared_ptr<const RomPack> pack;     // Holding `packed`, if set
+    const PackedRom *packed{};               // Loaded instead of `rom`
+    std::shared_ptr<Prepared> prepared;      // Shared by identical programs
+};
+
+struct Result {
+    std::string status; // limit, halt, key, replay, mismatch or error
+    uint64_t cycles{};  // Cycles emulated before stopping
+    uint16_t pc{};
+    uint64_t display{}; // FNV-1a hash of the final frame
+    double seconds{};
+    std::string error;
+};
+
+// `value` of option `key` as a number of at least `min`, or throws
+template <typename T>
+T Number(const std::string &key, const std::string &value, const T min) {
+    T number;
+    if (!ParseNumber(value, number, min)) {
+        throw std::invalid_argument("Bad " + key + ": " + value);
+    }
+    return number;
+}
+
+// Apply `key=value` to `job`, returns false for an unknown key and throws
+// for a bad value
+bool SetOption(Job &job, const std::string &key, const std::string &value) {
+    if (key == "replay") {
+        auto recording = std::make_shared<Recording>();
+        if (!recording->Load(value.c_str())) {
+            throw std::runtime_error("Could not load recording " + value);
+        }
+        job.quirks = ProfileName(recording->profile);
+        job.hz = recording->clock_hz;
+        job.cycles = recording->end;
+        job.seed = recording->seed;
+        job.replay = std::move(recording);
+    } else if (key == "quirks") {
+        job.quirks = value;
+    } else if (key == "engine") {
+        job.engine = value;
+    } else if (key == "hz") {
+        job.hz = Number<uint32_t>(key, value, 1);
+    } else if (key == "cycles") {
+        job.cycles = Number<uint64_t>(key, value, 0);
+    } else if (key == "seed") {
+        job.seed = Number<uint64_t>(key, value, 0);
+    } else if (key == "trace") {
+        job.trace = value;
+    } else if (key == "golden") {
+        auto golden = std::make_shared<std::vector<uint64_t>>();
+        if (!LoadFrameHashes(value.c_str(), *golden)) {
+            throw std::runtime_error("Could not load golden trace " + value);
+        }
+        job.golden = std::move(golden);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// One job per line: a ROM path followed by key=value overrides of `defaults`.
+// Blank lines and lines starting with '#' are skipped.
+bool ReadJobs(const char *filename, const Job &defaults,
+              std::vector<Job> &jobs) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (auto number = 1; std::getline(file, line); number++) {
+        std::istringstream fields(line);
+        Job job = defaults;
+        if (!(fields >> job.rom) || job.rom[0] == '#') {
+            continue;
+        }
+        for (std::string field; fields >> field;) {
+            const auto equals = field.find('=');
+            try {
+                if (equals == std::string::npos ||
+                    !SetOption(job, field.substr(0, equals),
+                               field.substr(equals + 1))) {
+                    throw std::invalid_argument("Unknown option: " + field);
+                }
+            } catch (const std::exception &e) {
+                std::cerr << filename << ":" << number << ": " << e.what()
+                          << std::endl;
+                return false;
+            }
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// One job per ROM in a pack, under its own quirks and clock if it has them
+bool AddPack(const char *filename, const Job &defaults,
+             std::vector<Job> &jobs) {
+    auto pack = std::make_shared<RomPack>();
+    if (!pack->Open(filename)) {
+        return false;
+    }
+    for (const auto &rom : pack->Roms()) {
+        Job job = defaults;
+        job.rom = std::string(filename) + ":" + std::string(rom.name);
+        job.quirks = ProfileName(rom.profile);
+        job.hz = rom.clock_hz ? rom.clock_hz : defaults.hz;
+        job.pack = pack;
+        job.packed = &rom;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// Run `job` until it halts, waits for a key (nothing will press one) or has
+// used up its cycles. A replay runs to the end of its recording instead.
+// A prepared job forks a machine whose program `analyses` prewarmed. Frames
+// end where chip-8's do at the same clock speed, so frame hash traces of the
+// two match.
+Result RunJob(const Job &job, AnalysisCache *analyses) {
+    Result result;
+    const auto start = std::chrono::steady_clock::now();
+
+    Profile profile;
+    if (!ParseProfile(job.quirks, profile)) {
+        result.status = "error";
+        result.error = "Unknown quirk profile: " + job.quirks;
+        return result;
+    }
+    if (job.engine != "interpreter" && job.engine != "threaded") {
+        result.status = "error";
+        result.error = "Unknown engine: " + job.engine;
+        return result;
+    }
+    if (job.hz == 0) {
+        result.status = "error";
+        result.error = "Clock speed must be positive";
+        return result;
+    }
+
+    // Too big for a worker's stack once several are in flight
+    const auto chip = std::make_unique<Chip8>(profile);
+    chip->engine =
+        job.engine == "threaded" ? Engine::Threaded : Engine::Interpreter;
+    const auto load = [&] {
+        return job.packed ? chip->LoadROM(job.packed->data, job.packed->size)
+                          : chip->LoadROM(job.rom.c_str());
+    };
+    auto loaded = false;
+    if (job.prepared) {
+        std::call_once(job.prepared->once, [&] {
+            if (load()) {
+                job.prepared->machine = analyses->Prepared(*chip);
+            }
+        });
+        if (job.prepared->machine) {
+            *chip = job.prepared->machine->Fork();
+            loaded = true;
+        }
+    } else {
+        loaded = load();
+    }
+    if (!loaded) {
+        result.status = "error";
+        result.error = "Could not load ROM";
+        return result;
+    }
+    chip->clock_hz = job.hz;
+    chip->Seed(job.seed);
+
+    FrameHashWriter trace;
+    if (!job.trace.empty() && !trace.Open(job.trace.c_str())) {
+        result.status = "error";
+        result.error = "Could not open trace " + job.trace;
+        return result;
+    }
+
+    // Check for a halt, and hash the frame if asked, once per emulated frame
+    FrameScheduler frames(job.hz, true, 0);
+    uint64_t frame = 0;
+    result.status = job.replay ? "replay" : "limit";
+    try {
+        while (chip->cycles < job.cycles) {
+            const uint64_t until =
+                std::min(chip->cycles + frames.NextBatch(), job.cycles);
+            if (job.replay) {
+                job.replay->Replay(*chip, until);
+            } else {
+                chip->RunCycles(until - chip->cycles);
+            }
+            if (!job.trace.empty()) {
+                trace.Present(chip->gfx);
+            }
+            if (job.golden && (frame == job.golden->size() ||
+                               HashFrame(chip->gfx) != (*job.golden)[frame])) {
+                result.status = "mismatch";
+                result.error = "Frame " + std::to_string(frame) +
+                               (frame == job.golden->size()
+                                    ? " is past the end of the golden trace"
+                                    : " differs from the golden trace");
+                break;
+            }
+            frame++;
+            if (job.replay) {
+                continue;
+            }
+            if (chip->idle == Idle::Halt) {
+                result.status = "halt";
+                break;
+            }
+            if (chip->idle == Idle::Key) {
+                result.status = "key";
+                break;
+            }
+        }
+    } catch (std::exception &e) {
+        result.status = "error";
+        result.error = e.what();
+    }
+    if (job.golden && result.status != "mismatch" &&
+        result.status != "error" && frame != job.golden->size()) {
+        result.status = "mismatch";
+        result.error = "Stopped at frame " + std::to_string(frame) + " of " +
+                       std::to_string(job.golden->size()) +
+                       " in the golden trace";
+    }
+    if (!job.trace.empty() && !trace.Close() && result.status != "error") {
+        result.status = "error";
+        result.error = "Could not write trace " + job.trace;
+    }
+
+    result.cycles = chip->cycles;
+    result.pc = chip->pc;
+    result.display = HashFrame(chip->gfx);
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return result;
+}
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    // Parse options, the remaining arguments are ROMs run with the defaults
+    Job defaults;
+    unsigned threads = 0;
+    const char *output = nullptr;
+    std::unique_ptr<AnalysisCache> analyses;
+    std::vector<const char *> job_files;
+    std::vector<Job> jobs;
+    try {
+        for (auto i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "--threads" && i + 1 < argc) {
+                threads = Number<unsigned>("threads", argv[++i], 0);
+            } else if (arg == "--jobs" && i + 1 < argc) {
+                job_files.push_back(argv[++i]);
+            } else if (arg == "--output" && i + 1 < argc) {
+                output = argv[++i];
+            } else if (arg == "--analysis-cache" && i + 1 < argc) {
+                analyses = std::make_unique<AnalysisCache>(argv[++i]);
+            } else if (arg == "--pack" && i + 1 < argc) {
+                if (!AddPack(argv[++i], defaults, jobs)) {
+                    return 1;
+                }
+            } else if (arg.starts_with("--") && i + 1 < argc &&
+                       SetOption(defaults, arg.substr(2), argv[i + 1])) {
+                i++;
+            } else if (arg.starts_with("--")) {
+                throw std::invalid_argument("Unknown option: " + arg);
+            } else {
+                Job job = defaults;
+                job.rom = arg;
+                jobs.push_back(job);
+            }
+        }
+        for (const auto filename : job_files) {
+            if (!ReadJobs(filename, defaults, jobs)) {
+                return 1;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        jobs.clear(); // Show the usage
+    }
+
+    if (jobs.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--threads N] [--output FILE] [--jobs FILE]..."
+                     " [--pack FILE]... [--analysis-cache DIR]"
+                     " [--quirks vip|chip48|schip|modern|xochip]"
+                     " [--engine interpreter|threaded] [--hz N]"
+                     " [--cycles N] [--seed N] [--replay FILE]"
+                     " [--trace FILE] [--golden FILE] [<filepath>...]"
+                  << std::endl;
+        return 1;
+    }
+
+    // Jobs of the same program, quirks and engine share one preparation
+    if (analyses) {
+        std::map<std::tuple<const PackedRom *, std::string, std::string,
+                            std::string>,
+                 std::shared_ptr<Prepared>>
+            programs;
+        for (auto &job : jobs) {
+            auto &prepared = programs[{job.packed, job.packed ? "" : job.rom,
+                                       job.quirks, job.engine}];
+            if (!prepared) {
+                prepared = std::make_shared<Prepared>();
+            }
+            job.prepared = prepared;
+        }
+    }
+
+    // Each job writes only its own slot
+    std::vector<Result> results(jobs.size());
+    std::vector<ThreadPool::Task> tasks;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        tasks.emplace_back(
+            [&, i] { results[i] = RunJob(jobs[i], analyses.get()); });
+    }
+    ThreadPool pool(threads);
+    const auto start = std::chrono::steady_clock::now();
+    pool.Run(std::move(tasks));
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    // Tab-separated, one row per job in input order
+    std::ofstream file;
+    if (output) {
+        file.open(output);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open file " << output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &out = output ? file : std::cout;
+    out << "rom\tquirks\tengine\thz\tstatus\tcycles\tpc\tdisplay\tseconds"
+           "\terror\n";
+    auto failed = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const Job &job = jobs[i];
+        const Result &result = results[i];
+        char hex[32];
+        std::snprintf(hex, sizeof(hex), "%03x\t%016llx", result.pc,
+                      static_cast<unsigned long long>(result.display));
+        out << job.rom << '\t' << job.quirks << '\t' << job.engine << '\t'
+            << job.hz << '\t' << result.status << '\t' << result.cycles
+            << '\t' << hex << '\t' << result.seconds << '\t' << result.error
+            << '\n';
+        failed += result.status == "error" || result.status == "mismatch";
+        total += result.cycles;
+    }
+
+    std::cerr << jobs.size() << " jobs (" << failed << " failed) on "
+              << pool.Threads() << " threads in " << seconds << " s, "
+              << total / seconds / 1e6 << " M cycles/s" << std::endl;
+    if (analyses) {
+        std::cerr << "analysis cache: " << analyses->hits << " hits, "
+                  << analyses->misses << " analysed" << std::endl;
+    }
+    return failed ? 1 : 0;
+}
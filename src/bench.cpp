@@ -0,0 +1,347 @@
+#include "Chip8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+// An opcode family measured in isolation: `setup` runs once, then `op`
+// repeats kLoopLength times in a loop closed by a jump back. A call's
+// target holds `subroutine`.
+struct Micro {
+    const char *name;
+    std::vector<uint16_t> setup;
+    uint16_t op;
+    uint16_t subroutine{};
+};
+
+constexpr int kLoopLength = 32;
+constexpr uint16_t kSubroutine = 0x400;
+
+// I points at data well away from the loop, so stores don't hit code.
+// Registers and timers stay zero unless set up otherwise.
+const Micro kMicros[] = {
+    {"00E0", {}, 0x00E0},
+    {"1nnn", {}, 0}, // A chain of jumps to the next instruction
+    {"2nnn/00EE", {}, 0x2000 | kSubroutine, 0x00EE},
+    {"3xkk", {}, 0x3001}, // Not taken
+    {"6xkk", {}, 0x6A55},
+    {"7xkk", {}, 0x7A01},
+    {"8xy4", {0x6BF0}, 0x8AB4},
+    {"8xy6", {}, 0x8AB6},
+    {"Annn", {}, 0xA800},
+    {"Cxkk", {}, 0xCAFF},
+    {"Dxyn", {0xA050}, 0xD015},
+    {"Ex9E", {}, 0xE09E}, // No key pressed: not taken
+    {"Fx07", {}, 0xFA07},
+    {"Fx1E", {0xA800}, 0xF01E},
+    {"Fx29", {}, 0xFA29},
+    {"Fx33", {0xA800, 0x6A7B}, 0xFA33},
+    {"Fx55", {0xA800}, 0xF755},
+    {"Fx65", {0xA800}, 0xF765},
+};
+
+struct Config {
+    std::vector<Engine> engines{Engine::Interpreter, Engine::Threaded};
+    uint64_t micro_cycles{20'000'000};
+    uint64_t rom_cycles{20'000'000};
+    uint32_t hz{700};
+    int repeat{5};
+    std::string filter;
+};
+
+struct Stats {
+    std::string name;
+    Engine engine{};
+    uint64_t cycles{};
+    std::vector<double> seconds{}; // One per repetition
+    double mean{};                 // ns/op
+    double min{};
+    double variance{};
+};
+
+const char *EngineName(const Engine engine) {
+    return engine == Engine::Threaded ? "threaded" : "interpreter";
+}
+
+void Summarize(Stats &stats) {
+    std::vector<double> ns;
+    for (const auto seconds : stats.seconds) {
+        ns.push_back(seconds * 1e9 / static_cast<double>(stats.cycles));
+    }
+    double sum = 0;
+    for (const auto value : ns) {
+        sum += value;
+    }
+    stats.mean = sum / ns.size();
+    stats.min = *std::min_element(ns.begin(), ns.end());
+    double squares = 0;
+    for (const auto value : ns) {
+        squares += (value - stats.mean) * (value - stats.mean);
+    }
+    stats.variance = ns.size() > 1 ? squares / (ns.size() - 1) : 0;
+}
+
+// One warm-up run, then `repeat` timed ones of a fresh machine each
+template <typename Prepare, typename Run>
+Stats Measure(const std::string &name, const Engine engine,
+              const uint64_t cycles, const Config &config,
+              const Prepare &prepare, const Run &run) {
+    Stats stats{name, engine, cycles};
+    for (auto i = -1; i < config.repeat; i++) {
+        Chip8 chip;
+        chip.engine = engine;
+        prepare(chip);
+        const auto start = std::chrono::steady_clock::now();
+        run(chip);
+        const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+        if (i >= 0) {
+            stats.seconds.push_back(seconds);
+        }
+    }
+    Summarize(stats);
+    return stats;
+}
+
+void LoadMicro(Chip8 &chip, const Micro &micro) {
+    std::vector<uint16_t> program = micro.setup;
+    const auto loop = static_cast<uint16_t>(0x200 + 2 * program.size());
+    for (auto i = 0; i < kLoopLength; i++) {
+        const auto next = static_cast<uint16_t>(loop + 2 * (i + 1));
+        program.push_back(micro.op ? micro.op : 0x1000 | next);
+    }
+    program.push_back(0x1000 | loop);
+
+    std::vector<uint8_t> bytes;
+    for (const auto opcode : program) {
+        bytes.push_back(opcode >> 8);
+        bytes.push_back(opcode & 0xFF);
+    }
+    chip.memory.Write(0x200, bytes.data(), bytes.size());
+    chip.memory.Write(kSubroutine, micro.subroutine >> 8);
+    chip.memory.Write(kSubroutine + 1, micro.subroutine & 0xFF);
+}
+
+// Opcode loops in one RunCycles call, at a clock fast enough that timer
+// ticks don't split it
+Stats RunMicro(const Micro &micro, const Engine engine,
+               const Config &config) {
+    return Measure(
+        std::string("op/") + micro.name, engine, config.micro_cycles, config,
+        [&](Chip8 &chip) {
+            chip.clock_hz = 1'000'000'000;
+            LoadMicro(chip, micro);
+        },
+        [&](Chip8 &chip) { chip.RunCycles(config.micro_cycles); });
+}
+
+std::string RomName(const std::string &rom) {
+    return "rom/" + std::filesystem::path(rom).filename().string();
+}
+
+// A ROM run the way a frontend does, one frame's cycles per RunCycles call.
+// Idle loops are fast-forwarded, so this is emulated, not executed, speed.
+Stats RunRom(const std::string &rom, const Engine engine,
+             const Config &config) {
+    const uint64_t frame = std::max<uint32_t>(1, config.hz / 60);
+    return Measure(
+        RomName(rom), engine, config.rom_cycles, config,
+        [&](Chip8 &chip) {
+            chip.clock_hz = config.hz;
+            chip.Seed(0);
+            if (!chip.LoadROM(rom.c_str())) {
+                throw std::runtime_error(RomName(rom) + " not run");
+            }
+        },
+        [&](Chip8 &chip) {
+            while (chip.cycles < config.rom_cycles) {
+                chip.RunCycles(
+                    std::min(frame, config.rom_cycles - chip.cycles));
+            }
+        });
+}
+
+std::string Quote(const std::string &text) {
+    std::string out = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void WriteJson(std::ostream &out, const std::vector<Stats> &results,
+               const Config &config) {
+    out << "{\n  \"repeat\": " << config.repeat
+        << ",\n  \"hz\": " << config.hz << ",\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Stats &stats = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": " << Quote(stats.name)
+            << ", \"engine\": \"" << EngineName(stats.engine)
+            << "\", \"cycles\": " << stats.cycles
+            << ", \"mips\": " << 1e3 / stats.mean
+            << ", \"ns_per_op\": " << stats.mean
+            << ", \"ns_per_op_min\": " << stats.min
+            << ", \"ns_per_op_variance\": " << stats.variance
+            << ", \"seconds\": [";
+        for (size_t j = 0; j < stats.seconds.size(); j++) {
+            out << (j ? ", " : "") << stats.seconds[j];
+        }
+        out << "]}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// ROM arguments may be directories, which stand for the .ch8 files in them
+bool CollectRoms(const std::vector<std::string> &paths,
+                 std::vector<std::string> &roms) {
+    for (const auto &path : paths) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(path, error)) {
+            roms.push_back(path);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (const auto &entry :
+             std::filesystem::directory_iterator(path, error)) {
+            if (entry.path().extension() == ".ch8") {
+                found.push_back(entry.path().string());
+            }
+        }
+        if (error) {
+            std::cerr << "Error: Could not read directory " << path
+                      << std::endl;
+            return false;
+        }
+        std::sort(found.begin(), found.end());
+        roms.insert(roms.end(), found.begin(), found.end());
+    }
+    return true;
+}
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    // Parse options, the remaining arguments are ROMs or directories of them
+    Config config;
+    const char *json = nullptr;
+    auto micro = true;
+    std::vector<std::string> paths;
+    try {
+        for (auto i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "--engine" && i + 1 < argc) {
+                const std::string name = argv[++i];
+                if (name == "interpreter") {
+                    config.engines = {Engine::Interpreter};
+                } else if (name == "threaded") {
+                    config.engines = {Engine::Threaded};
+                } else if (name != "both") {
+                    std::cerr << "Unknown engine: " << name << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--micro-cycles" && i + 1 < argc) {
+                config.micro_cycles = std::stoull(argv[++i]);
+            } else if (arg == "--cycles" && i + 1 < argc) {
+                config.rom_cycles = std::stoull(argv[++i]);
+            } else if (arg == "--hz" && i + 1 < argc) {
+                config.hz = std::stoul(argv[++i]);
+            } else if (arg == "--repeat" && i + 1 < argc) {
+                config.repeat = std::stoi(argv[++i]);
+            } else if (arg == "--filter" && i + 1 < argc) {
+                config.filter = argv[++i];
+            } else if (arg == "--no-micro") {
+                micro = false;
+            } else if (arg == "--json" && i + 1 < argc) {
+                json = argv[++i];
+            } else if (arg.starts_with("--")) {
+                throw std::invalid_argument("Unknown option: " + arg);
+            } else {
+                paths.push_back(arg);
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0]
+                  << " [--engine interpreter|threaded|both]"
+                     " [--micro-cycles N] [--cycles N] [--hz N]"
+                     " [--repeat N] [--filter TEXT] [--no-micro]"
+                     " [--json FILE] [<rom or directory>...]"
+                  << std::endl;
+        return 1;
+    }
+    if (config.repeat < 1 || config.hz == 0 || config.micro_cycles == 0 ||
+        config.rom_cycles == 0) {
+        std::cerr << "Counts and the clock speed must be positive"
+                  << std::endl;
+        return 1;
+    }
+
+    // Without arguments, the ROMs shipped in roms/ when run from the source
+    if (paths.empty() && std::filesystem::is_directory("roms")) {
+        paths.emplace_back("roms");
+    }
+    std::vector<std::string> roms;
+    if (!CollectRoms(paths, roms)) {
+        return 1;
+    }
+
+    // Micro benchmarks first, then ROMs; each under every engine in turn
+    std::vector<Stats> results;
+    const auto selected = [&](const std::string &name) {
+        return name.find(config.filter) != std::string::npos;
+    };
+    const auto report = [&](const Stats &stats) {
+        std::printf("%-28s %-12s %10.1f %10.3f %10.3f %8.1f\n",
+                    stats.name.c_str(), EngineName(stats.engine),
+                    1e3 / stats.mean, stats.mean, stats.min,
+                    100 * std::sqrt(stats.variance) / stats.mean);
+        std::fflush(stdout);
+        results.push_back(stats);
+    };
+    std::printf("%-28s %-12s %10s %10s %10s %8s\n", "benchmark", "engine",
+                "MIPS", "ns/op", "min", "stddev%");
+    try {
+        for (const auto engine : config.engines) {
+            for (const auto &entry : kMicros) {
+                if (micro && selected(std::string("op/") + entry.name)) {
+                    report(RunMicro(entry, engine, config));
+                }
+            }
+            for (const auto &rom : roms) {
+                if (selected(RomName(rom))) {
+                    report(RunRom(rom, engine, config));
+                }
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (json) {
+        std::ofstream file(json);
+        WriteJson(file, results, config);
+        if (!file) {
+            std::cerr << "Error: Could not write file " << json << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -1,177 +1,527 @@
+#include "BlockEngine.h"
 #include "Chip8.h"
+#include "Debugger.h"
+#include "FrameScheduler.h"
+#include "FrameSink.h"
+#include "KeyRepeat.h"
+#include "ParseNumber.h"
+#include "Profiler.h"
+#include "Recording.h"
+#include "Renderer.h"
+#include "SaveState.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
 
+#include <algorithm>
+#include <bit>
 #include <chrono>
+#include <clocale>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <ncurses.h>
+#include <random>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
+
+namespace {
+// Input thread to emulation thread
+struct Command {
+    enum Kind : uint8_t {
+        Press,
+        Release,
+        Rewind,
+        Save,
+        Load,
+        Step,
+        Continue,
+        Quit
+    };
+    Kind kind;
+    uint8_t key{};                              // Press, Release: hex key
+    std::chrono::steady_clock::time_point at{}; // When the key came in
+};
+
+// Emulation thread to render thread, once per presented frame
+struct Frame {
+    Display gfx;
+    uint64_t beeps{};  // Sound timer expiries so far
+    char status[160]{}; // Debugger or --profile-status line, if any
+    bool finished{};   // The last frame: the machine stopped
+};
+
+// Hex keypad on the left of the keyboard:
+//   1 2 3 C       1 2 3 4
+//   4 5 6 D  <-   q w e r
+//   7 8 9 E       a s d f
+//   A 0 B F       z x c v
+int HexKey(const int ch) {
+    constexpr char kLayout[] = "x123qweasdzc4rfv";
+    for (auto key = 0; key < 16; key++) {
+        if (ch == kLayout[key]) {
+            return key;
+        }
+    }
+    return -1;
+}
+} // namespace
 
 int main(const int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <filepath>" << std::endl;
+    // Parse options, the last argument is the ROM
+    const char *rom = nullptr;
+    auto engine = Engine::Interpreter;
+    auto profile = Profile::Modern;
+    auto half_blocks = false;
+    auto hz = 700; // CPU Speed
+    auto speed = 1.0;
+    auto turbo = false;
+    auto frame_skip = 0;
+    uint64_t seed = std::random_device{}();
+    const char *record = nullptr;
+    auto rewind_mb = 16;        // Rewind history budget
+    auto repeat_delay = 500;    // ms a first press is held without repeats
+    auto repeat_interval = 100; // ms between repeats of a held key
+    const char *profile_file = nullptr;
+    auto profile_status = false;
+    auto headless = false;
+    uint64_t max_cycles = 10'000'000; // Headless
+    const char *stream_file = nullptr;
+    const char *hashes_file = nullptr;
+    std::vector<Breakpoint> breakpoints;
+    std::vector<Watchpoint> watchpoints;
+    size_t trace = 0; // Instructions the debugger keeps
+    auto bad = false; // A malformed or out-of-range number
+    for (auto i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--engine" && i + 1 < argc) {
+            const std::string name = argv[++i];
+            if (name == "interpreter") {
+                engine = Engine::Interpreter;
+            } else if (name == "threaded") {
+                engine = Engine::Threaded;
+            } else {
+                std::cerr << "Unknown engine: " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--quirks" && i + 1 < argc) {
+            if (!ParseProfile(argv[++i], profile)) {
+                std::cerr << "Unknown quirk profile: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--half-blocks") {
+            half_blocks = true;
+        } else if (arg == "--hz" && i + 1 < argc) {
+            bad |= !ParseNumber(argv[++i], hz, 1);
+        } else if (arg == "--speed" && i + 1 < argc) {
+            bad |= !ParseNumber(argv[++i], speed, 0.0) || speed == 0;
+        } else if (arg == "--turbo") {
+            turbo = true;
+        } else if (arg == "--frame-skip" && i + 1 < argc) {
+            bad |= !ParseNumber(argv[++i], frame_skip, 0);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            bad |= !ParseNumber<uint64_t>(argv[++i], seed, 0);
+        } else if (arg == "--record" && i + 1 < argc) {
+            record = argv[++i];
+        } else if (arg == "--rewind-mb" && i + 1 < argc) {
+            bad |= !ParseNumber(argv[++i], rewind_mb, 0);
+        } else if (arg == "--repeat-delay" && i + 1 < argc) {
+            bad |= !ParseNumber(argv[++i], repeat_delay, 0);
+        } else if (arg == "--repeat-interval" && i + 1 < argc) {
+            bad |= !ParseNumber(argv[++i], repeat_interval, 0);
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if (arg == "--profile-status") {
+            profile_status = true;
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--cycles" && i + 1 < argc) {
+            bad |= !ParseNumber<uint64_t>(argv[++i], max_cycles, 0);
+        } else if (arg == "--stream" && i + 1 < argc) {
+            stream_file = argv[++i];
+        } else if (arg == "--hashes" && i + 1 < argc) {
+            hashes_file = argv[++i];
+        } else if (arg == "--break" && i + 1 < argc) {
+            if (!ParseBreakpoint(argv[++i], breakpoints.emplace_back())) {
+                std::cerr << "Bad breakpoint: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--watch" && i + 1 < argc) {
+            if (!ParseWatchpoint(argv[++i], watchpoints.emplace_back())) {
+                std::cerr << "Bad watchpoint: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            bad |= !ParseNumber<size_t>(argv[++i], trace, 0);
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (!rom || bad) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--engine interpreter|threaded]"
+                     " [--quirks vip|chip48|schip|modern|xochip]"
+                     " [--half-blocks] [--hz N] [--speed X]"
+                     " [--turbo [--frame-skip N]] [--seed N] [--record FILE]"
+                     " [--rewind-mb N]"
+                     " [--repeat-delay MS] [--repeat-interval MS]"
+                     " [--profile FILE [--profile-status]]"
+                     " [--headless [--cycles N]] [--stream FILE]"
+                     " [--hashes FILE] [--break ADDR[:REG OP VALUE]]..."
+                     " [--watch ADDR[-ADDR]]... [--trace N] <filepath>"
+                  << std::endl;
+        return 1;
+    }
+    if (profile_file && !kProfiling) {
+        std::cerr << "--profile needs a build with -DCHIP8_PROFILE=ON"
+                  << std::endl;
         return 1;
     }
 
     // Create instance
-    Chip8 chip;
+    Chip8 chip(profile);
+    chip.engine = engine;
+    chip.clock_hz = hz;
 
     // Load ROM
-    if (!chip.LoadROM(argv[1])) {
+    if (!chip.LoadROM(rom)) {
         return 1;
     }
 
-    // Initialize ncurses
-    initscr();             // Init screen
-    noecho();              // Don't print key presses to screen
-    raw();                 // Pass everything typed directly into program
-    nodelay(stdscr, true); // Make input reading non-blocking
-    curs_set(0);           // Hide cursor
-    keypad(stdscr, TRUE);  // Enable function keys
-
-    constexpr auto cpu_cycle_delay =
-        std::chrono::nanoseconds(1000000000 / 700); // 700 Hz CPU Speed
-    constexpr auto timer_cycle_delay =
-        std::chrono::microseconds(1000000 / 60); // 60 Hz Timers
-    auto last_cpu_cycle = std::chrono::high_resolution_clock::now();
-    auto last_timer_cycle = std::chrono::high_resolution_clock::now();
-
-    try {
-        while (!chip.stop_flag) {
-            int ch;
-            while ((ch = getch()) != ERR) {
-                constexpr uint8_t KEY_PRESS_TIMEOUT = 30;
-                switch (ch) {
-                    case KEY_RESIZE: {
-                        chip.draw_flag = true;
-                        break;
-                    }
-                    case '1':
-                        chip.keypad_timers[0x1] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case '2':
-                        chip.keypad_timers[0x2] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case '3':
-                        chip.keypad_timers[0x3] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case '4':
-                        chip.keypad_timers[0xC] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'q':
-                        chip.keypad_timers[0x4] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'w':
-                        chip.keypad_timers[0x5] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'e':
-                        chip.keypad_timers[0x6] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'r':
-                        chip.keypad_timers[0xD] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'a':
-                        chip.keypad_timers[0x7] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 's':
-                        chip.keypad_timers[0x8] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'd':
-                        chip.keypad_timers[0x9] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'f':
-                        chip.keypad_timers[0xE] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'z':
-                        chip.keypad_timers[0xA] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'x':
-                        chip.keypad_timers[0x0] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'c':
-                        chip.keypad_timers[0xB] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 'v':
-                        chip.keypad_timers[0xF] = KEY_PRESS_TIMEOUT;
-                        break;
-                    case 3:  // SIGINT (Ctrl + C)
-                    case 27: // Escape key
-                    {
-                        chip.stop_flag = true;
-                        break;
-                    }
-                    default: {
-                        break;
-                    }
-                }
-            }
+    // Record the seed and key presses, so that the session can be replayed
+    chip.Seed(seed);
+    Recording recording(chip, seed);
+    bool replayable = true; // No rewind or load the recording can't show
 
-            auto current_time = std::chrono::high_resolution_clock::now();
-            auto delta_timer_time = current_time - last_timer_cycle;
-            auto delta_cpu_time = current_time - last_cpu_cycle;
+    // Backspace steps back through the last frames, F5 / F9 save and load
+    // F7 steps one instruction (stopping the machine first if it runs), F8
+    // lets it run on. Nothing set, the debugger costs a check per timer tick,
+    // so it is always there to stop a misbehaving ROM.
+    Debugger debugger(trace);
+    for (const auto &breakpoint : breakpoints) {
+        debugger.Add(breakpoint);
+    }
+    for (const auto &watchpoint : watchpoints) {
+        debugger.Add(watchpoint);
+    }
+    chip.debugger = &debugger;
+    RewindBuffer rewind(static_cast<size_t>(rewind_mb) << 20);
+    const std::string state_file = std::string(rom) + ".state";
 
-            if (delta_timer_time >= timer_cycle_delay) {
-                last_timer_cycle = current_time;
+    // Frame outputs fed by the emulation thread itself, so they get every
+    // presented frame however far behind the terminal falls
+    FrameStreamWriter stream;
+    FrameHashWriter hashes;
+    std::vector<FrameSink *> sinks;
+    if (stream_file) {
+        if (!stream.Open(stream_file)) {
+            return 1;
+        }
+        sinks.push_back(&stream);
+    }
+    if (hashes_file) {
+        if (!hashes.Open(hashes_file)) {
+            return 1;
+        }
+        sinks.push_back(&hashes);
+    }
 
-                // Decrement timers
-                if (chip.delay_timer > 0) {
-                    chip.delay_timer--;
-                }
-                if (chip.sound_timer > 0) {
-                    chip.sound_timer--;
-                    if (chip.sound_timer == 0) {
-                        beep();
+    // Initialize ncurses, unless running headless
+    std::unique_ptr<TerminalRenderer> renderer;
+    if (!headless) {
+        setlocale(LC_ALL, ""); // UTF-8 output for half-block mode
+        initscr();             // Init screen
+        noecho();              // Don't print key presses to screen
+        raw();                 // Pass everything typed directly into program
+        timeout(2);            // Wait at most 2 ms for a key, then render
+        curs_set(0);           // Hide cursor
+        keypad(stdscr, TRUE);  // Enable function keys
+
+        renderer = std::make_unique<TerminalRenderer>(half_blocks);
+    }
+
+    // Written at exit, and summed up on the bottom line with --profile-status
+    std::unique_ptr<Profiler> profiler;
+    if (profile_file) {
+        profiler = std::make_unique<Profiler>();
+        chip.profiler = profiler.get();
+    }
+    const double target_hz = hz * speed;
+
+    // The emulation thread owns the machine and paces it in 60 Hz frames.
+    // This thread owns the terminal: ncurses can't be shared between
+    // threads, so it both polls input and renders, while a slow terminal
+    // write only ever delays the next frame shown, never emulation.
+    // Headless, there is no terminal: frames of emulated time run back to
+    // back until the machine halts, waits for a key or reaches --cycles.
+    SpscQueue<Command, 64> commands;
+    TripleBuffer<Frame> frames;
+    std::string error;
+
+    std::thread emulation([&] {
+        FrameScheduler scheduler(headless ? hz : target_hz, turbo || headless,
+                                 frame_skip);
+        uint64_t beeps = 0;
+        KeyRepeat::Clock::time_point pressed{}; // Oldest press not yet shown
+        try {
+            while (!chip.stop_flag) {
+                auto rewinding = false;
+                auto quit = false; // Kept past a load or rewind after it
+                for (Command command; commands.Pop(command);) {
+                    switch (command.kind) {
+                        case Command::Press:
+                            recording.SetKey(chip, command.key, true);
+                            if (pressed == KeyRepeat::Clock::time_point{}) {
+                                pressed = command.at;
+                            }
+                            break;
+                        case Command::Release:
+                            recording.SetKey(chip, command.key, false);
+                            break;
+                        case Command::Rewind:
+                            rewinding = true;
+                            break;
+                        case Command::Save:
+                            SaveState(chip, state_file.c_str());
+                            break;
+                        case Command::Load:
+                            replayable &= !LoadState(chip, state_file.c_str());
+                            break;
+                        case Command::Step:
+                            debugger.Step();
+                            break;
+                        case Command::Continue:
+                            debugger.Continue();
+                            break;
+                        case Command::Quit:
+                            quit = true;
+                            break;
                     }
                 }
-                for (int i = 0; i < 16; ++i) {
-                    if (chip.keypad_timers[i] > 0) {
-                        chip.keypad_timers[i]--;
+
+                const uint64_t before = chip.cycles;
+                if (rewinding) {
+                    const Profiler::Scope timer(profiler.get(),
+                                                Section::Emulate);
+                    // Key repeat sends a few presses a second: go back
+                    // faster
+                    constexpr int REWIND_FRAMES = 6;
+                    for (auto i = 0; i < REWIND_FRAMES && rewind.Rewind(chip);
+                         i++) {
+                        replayable = false;
+                    }
+                } else {
+                    const Profiler::Scope timer(profiler.get(),
+                                                Section::Emulate);
+                    // Run this frame's batch of cycles. Timers tick on the
+                    // virtual clock as the cycles run.
+                    auto batch = scheduler.NextBatch();
+                    if (headless) {
+                        batch = std::min(batch, max_cycles - chip.cycles);
+                    }
+                    // Stopped by the debugger, nothing new to keep
+                    if (chip.RunCycles(batch)) {
+                        rewind.Push(chip);
                     }
                 }
-            }
+                chip.stop_flag |= quit;
+                // Headless, no key will ever come to wake an idle machine,
+                // nor one to carry on from a stop
+                if (headless &&
+                    (chip.idle == Idle::Key || chip.idle == Idle::Halt ||
+                     chip.idle == Idle::Break || chip.cycles >= max_cycles)) {
+                    chip.stop_flag = true;
+                }
 
-            if (delta_cpu_time >= cpu_cycle_delay) {
-                last_cpu_cycle = current_time;
+                if (chip.SoundEnded()) {
+                    beeps++;
+                }
 
-                // Derive keypad state from timers
-                for (int i = 0; i < 16; ++i) {
-                    chip.keypad[i] = (chip.keypad_timers[i] > 0);
+                Frame *status = nullptr;
+                if (scheduler.ShouldPresent() || chip.stop_flag) {
+                    for (auto *sink : sinks) {
+                        sink->Present(chip.gfx);
+                    }
+                    // Hand the frame over; the render thread draws only the
+                    // newest one if it falls behind
+                    Frame &frame = frames.Back();
+                    frame.gfx = chip.gfx;
+                    chip.draw_flag = false;
+                    frame.beeps = beeps;
+                    frame.finished = chip.stop_flag;
+                    frame.status[0] = '\0';
+                    status = &frame;
                 }
 
-                // Execute a single Opcode
-                chip.HandleOpcode();
-
-                // Render
-                if (chip.draw_flag) {
-                    clear();
-                    int term_y, term_x;
-                    getmaxyx(stdscr, term_y, term_x);
-                    const int start_y = (term_y - 32) / 2;
-                    const int start_x = (term_x - 64) / 2;
-
-                    for (auto y = 0; y < 32; y++) {
-                        for (auto x = 0; x < 64; x++) {
-                            if (chip.gfx[x][y]) {
-                                mvaddch(start_y + y, start_x + x, '#');
-                            } else {
-                                mvaddch(start_y + y, start_x + x, ' ');
-                            }
+                if constexpr (kProfiling) {
+                    if (profiler && status &&
+                        pressed != KeyRepeat::Clock::time_point{}) {
+                        profiler->InputLatency(KeyRepeat::Clock::now() -
+                                               pressed);
+                    }
+                    if (profiler) {
+                        // A rewind emulates nothing
+                        profiler->EndFrame(
+                            chip.cycles > before ? chip.cycles - before : 0);
+                        if (profile_status && status) {
+                            std::snprintf(status->status,
+                                          sizeof(status->status), "%s",
+                                          profiler->Status(target_hz).c_str());
                         }
                     }
-                    refresh();
-                    chip.draw_flag = false;
                 }
+                if (status && debugger.Stopped()) {
+                    std::snprintf(status->status, sizeof(status->status),
+                                  "%s  F7 step, F8 continue",
+                                  debugger.Status(chip).c_str());
+                }
+                if (status) {
+                    frames.Publish();
+                    pressed = {};
+                }
+
+                // Sleep until the next frame is due. Waiting for a key or
+                // halted means nothing changes without input, so turbo can
+                // sleep too.
+                const Profiler::Scope timer(profiler.get(), Section::Sleep);
+                scheduler.EndFrame(!headless && (chip.idle == Idle::Key ||
+                                                  chip.idle == Idle::Halt ||
+                                                  chip.idle == Idle::Break));
             }
+        } catch (const std::runtime_error &e) {
+            error = e.what();
+            frames.Back().finished = true;
+            frames.Publish();
+        }
+    });
+
+    // Input and rendering until the emulation thread has stopped, neither
+    // if headless
+    KeyRepeat repeat{std::chrono::milliseconds(repeat_delay),
+                     std::chrono::milliseconds(repeat_interval)};
+    uint64_t beeps = 0;
+    std::string status;
+    // Key and quit commands wait here while the queue is full, as a lost
+    // release would leave its key held for good. The rest may be dropped.
+    std::vector<Command> pending;
+    for (auto finished = headless; !finished;) {
+        int ch;
+        {
+            const Profiler::Scope timer(profiler.get(), Section::Input);
+            ch = getch(); // Waits up to 2 ms
+        }
+        const auto now = KeyRepeat::Clock::now();
+        if (const auto key = HexKey(ch);
+            key >= 0 && repeat.Press(key, now)) {
+            pending.push_back(
+                {Command::Press, static_cast<uint8_t>(key), now});
+        }
+        for (auto released = repeat.Release(now); released;
+             released &= released - 1) {
+            pending.push_back(
+                {Command::Release,
+                 static_cast<uint8_t>(std::countr_zero(released)), now});
+        }
+        switch (ch) {
+            case KEY_RESIZE:
+                renderer->Invalidate();
+                status.clear();
+                break;
+            case KEY_BACKSPACE:
+            case 127:
+            case 8:
+                commands.Push({Command::Rewind});
+                break;
+            case KEY_F(5):
+                commands.Push({Command::Save});
+                break;
+            case KEY_F(9):
+                commands.Push({Command::Load});
+                renderer->Invalidate();
+                break;
+            case KEY_F(7):
+                commands.Push({Command::Step});
+                break;
+            case KEY_F(8):
+                commands.Push({Command::Continue});
+                break;
+            case 3:  // SIGINT (Ctrl + C)
+            case 27: // Escape key
+                pending.push_back({Command::Quit});
+                break;
+            default:
+                break;
+        }
+        auto sent = pending.begin();
+        while (sent != pending.end() && commands.Push(*sent)) {
+            ++sent;
+        }
+        pending.erase(pending.begin(), sent);
 
-            // Prevent 100% CPU
-            std::this_thread::sleep_for(std::chrono::nanoseconds(100));
+        if (!frames.Update()) {
+            continue;
+        }
+        const Frame &frame = frames.Front();
+        finished = frame.finished;
+        const Profiler::Scope timer(profiler.get(), Section::Render);
+        if (frame.beeps != beeps) {
+            beeps = frame.beeps;
+            beep();
         }
-    } catch (const std::runtime_error &e) {
+        // Render changed cells
+        renderer->Present(frame.gfx);
+        if (status != frame.status) {
+            status = frame.status;
+            mvaddstr(LINES - 1, 0, status.c_str());
+            clrtoeol();
+            refresh();
+        }
+    }
+    emulation.join();
+
+    if (!headless) {
         endwin();
-        std::cerr << "\n" << e.what() << std::endl;
+    }
+    // Written out on their own threads: wait for the last of it
+    auto written = stream.Close();
+    written &= hashes.Close();
+
+    if (profiler && !profiler->Write(profile_file, target_hz)) {
         return 1;
     }
 
-    endwin();
-    return 0;
-}
\ No newline at end of file
+    // Where the machine was, and with --trace how it got there
+    if (!error.empty()) {
+        std::cerr << "\n" << error << std::endl << debugger.Report(chip);
+        if (record && replayable) {
+            recording.Finish(chip);
+            recording.Save(record);
+        }
+        return 1;
+    }
+    if (debugger.Stopped()) {
+        std::cerr << debugger.Report(chip);
+    }
+
+    if (record && !replayable) {
+        std::cerr << "Not saving the recording: the session was rewound or "
+                     "a state loaded"
+                  << std::endl;
+    } else if (record) {
+        recording.Finish(chip);
+        if (!recording.Save(record)) {
+            return 1;
+        }
+    }
+
+    if (chip.block_engine) {
+        const auto &fusions = chip.block_engine->fusions;
+        std::cerr << "Superinstructions run: " << fusions.load_runs
+                  << " load runs, " << fusions.load_draws << " load+draws, "
+                  << fusions.delay_polls << " delay polls" << std::endl;
+    }
+    return written ? 0 : 1;
+}
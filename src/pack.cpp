@@ -0,0 +1,124 @@
+#include "Chip8.h"
+#include "MappedFile.h"
+#include "RomPack.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+// A ROM file to pack and the configuration given before it
+struct Input {
+    std::string path;
+    Profile profile{Profile::Modern};
+    uint32_t clock_hz{};
+};
+
+// A directory stands for the .ch8 files in it, in name order
+bool Collect(const Input &input, std::vector<Input> &inputs) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(input.path, error)) {
+        inputs.push_back(input);
+        return true;
+    }
+    std::vector<std::string> found;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(input.path, error)) {
+        if (entry.path().extension() == ".ch8") {
+            found.push_back(entry.path().string());
+        }
+    }
+    if (error) {
+        std::cerr << "Error: Could not read directory " << input.path
+                  << std::endl;
+        return false;
+    }
+    std::sort(found.begin(), found.end());
+    for (auto &path : found) {
+        inputs.push_back({std::move(path), input.profile, input.clock_hz});
+    }
+    return true;
+}
+
+// One line per ROM in index order: hash, size, quirks, clock and name
+int List(const char *filename) {
+    RomPack pack;
+    if (!pack.Open(filename)) {
+        return 1;
+    }
+    for (const auto &rom : pack.Roms()) {
+        std::printf("%016llx\t%zu\t%s\t%u\t%.*s\n",
+                    static_cast<unsigned long long>(rom.hash), rom.size,
+                    ProfileName(rom.profile), rom.clock_hz,
+                    static_cast<int>(rom.name.size()), rom.name.data());
+    }
+    return 0;
+}
+} // namespace
+
+int main(const int argc, char *argv[]) {
+    // Parse options; --quirks and --hz apply to the ROMs that follow them
+    const char *output = nullptr;
+    Input current;
+    std::vector<Input> inputs;
+    try {
+        for (auto i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "--list" && i + 1 < argc) {
+                return List(argv[++i]);
+            } else if (arg == "--output" && i + 1 < argc) {
+                output = argv[++i];
+            } else if (arg == "--quirks" && i + 1 < argc) {
+                if (!ParseProfile(argv[++i], current.profile)) {
+                    throw std::invalid_argument(
+                        std::string("Unknown quirk profile: ") + argv[i]);
+                }
+            } else if (arg == "--hz" && i + 1 < argc) {
+                current.clock_hz = std::stoul(argv[++i]);
+            } else if (arg.starts_with("--")) {
+                throw std::invalid_argument("Unknown option: " + arg);
+            } else {
+                current.path = arg;
+                if (!Collect(current, inputs)) {
+                    return 1;
+                }
+            }
+        }
+        if (!output || inputs.empty()) {
+            throw std::invalid_argument("Nothing to pack");
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0]
+                  << " --output FILE"
+                     " [--quirks vip|chip48|schip|modern|xochip]"
+                     " [--hz N] <rom or directory>...\n"
+                     "       "
+                  << argv[0] << " --list FILE" << std::endl;
+        return 1;
+    }
+
+    // The pack is written from the mapped ROMs directly
+    std::vector<MappedFile> files(inputs.size());
+    std::vector<std::string> names(inputs.size());
+    std::vector<PackedRom> roms;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (!files[i].Open(inputs[i].path.c_str())) {
+            std::cerr << "Error: Could not open file " << inputs[i].path
+                      << std::endl;
+            return 1;
+        }
+        names[i] = std::filesystem::path(inputs[i].path).filename().string();
+        roms.push_back({names[i], inputs[i].profile, inputs[i].clock_hz,
+                        files[i].Data(), files[i].Size()});
+    }
+    if (!RomPack::Write(output, std::move(roms))) {
+        return 1;
+    }
+    std::cerr << inputs.size() << " ROMs packed into " << output << std::endl;
+    return 0;
+}